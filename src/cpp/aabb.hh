@@ -0,0 +1,91 @@
+#ifndef AABB_HH
+#define AABB_HH
+
+#include "rtweekend.hh"
+
+#include <utility>
+
+// axis aligned bounding box, stored as one interval per axis
+template <typename T>
+class basic_aabb
+{
+public:
+    basic_interval<T> x, y, z;
+
+    basic_aabb() {} // default box is empty (all intervals are empty)
+
+    basic_aabb(const basic_interval<T> &ix, const basic_interval<T> &iy, const basic_interval<T> &iz) : x(ix), y(iy), z(iz) {}
+
+    basic_aabb(const basic_point3<T> &a, const basic_point3<T> &b)
+    {
+        // treat a and b as extrema of the box, so they don't need to be in a particular order
+        x = basic_interval<T>(std::fmin(a[0], b[0]), std::fmax(a[0], b[0]));
+        y = basic_interval<T>(std::fmin(a[1], b[1]), std::fmax(a[1], b[1]));
+        z = basic_interval<T>(std::fmin(a[2], b[2]), std::fmax(a[2], b[2]));
+    }
+
+    basic_aabb(const basic_aabb &box0, const basic_aabb &box1) : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+    const basic_interval<T> &axis(int n) const
+    {
+        if (n == 1)
+            return y;
+        if (n == 2)
+            return z;
+        return x;
+    }
+
+    bool empty() const
+    {
+        return x.size() < 0 || y.size() < 0 || z.size() < 0;
+    }
+
+    basic_point3<T> centroid() const
+    {
+        return basic_point3<T>((x.min + x.max) / 2, (y.min + y.max) / 2, (z.min + z.max) / 2);
+    }
+
+    int longest_axis() const
+    {
+        if (x.size() > y.size())
+            return x.size() > z.size() ? 0 : 2;
+        return y.size() > z.size() ? 1 : 2;
+    }
+
+    T surface_area() const
+    {
+        if (empty())
+            return 0;
+        auto dx = x.size(), dy = y.size(), dz = z.size();
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // slab test: intersect the ray with the three pairs of planes and check if the resulting intervals overlap
+    bool hit(const basic_ray<T> &r, basic_interval<T> ray_t) const
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            auto invD = 1 / r.direction()[a];
+            auto orig = r.origin()[a];
+
+            auto t0 = (axis(a).min - orig) * invD;
+            auto t1 = (axis(a).max - orig) * invD;
+
+            if (invD < 0)
+                std::swap(t0, t1);
+
+            if (t0 > ray_t.min)
+                ray_t.min = t0;
+            if (t1 < ray_t.max)
+                ray_t.max = t1;
+
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+};
+
+using aabb = basic_aabb<double>;
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef AOV_HH
+#define AOV_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+// arbitrary output variables: extra channels of every pixel that a render produces from the same samples as the color.
+// Each channel is stored in a plane of its own (see basic_image_memory) and each aov is written to a file of its own.
+enum class aov
+{
+    depth,     // mean distance from the camera to the first hit, 0 where the sky was hit
+    normal,    // mean normal of the first hit facing the camera, 0 where the sky was hit, 3 channels
+    albedo,    // mean attenuation of the first hit or the sky color, 3 channels
+    object_id, // index of the object the first sample of the pixel hit in the scene, -1 for the sky
+    ray_count, // rays traced for the pixel: the camera rays and every bounce, what the pixel cost
+    count
+};
+
+// any number of aovs, one bit each
+using aov_set = uint32_t;
+
+constexpr aov_set aov_bit(aov a)
+{
+    return aov_set(1) << static_cast<int>(a);
+}
+
+constexpr bool has_aov(aov_set set, aov a)
+{
+    return (set & aov_bit(a)) != 0;
+}
+
+constexpr int aov_channels(aov a)
+{
+    return a == aov::normal || a == aov::albedo ? 3 : 1;
+}
+
+// the channels of all aovs are numbered one after the other, in the order of the enum
+constexpr int aov_first_channel(aov a)
+{
+    int first = 0;
+    for (int i = 0; i < static_cast<int>(a); i++)
+        first += aov_channels(static_cast<aov>(i));
+    return first;
+}
+
+constexpr int aov_channel_count = aov_first_channel(aov::count);
+
+inline const char *aov_name(aov a)
+{
+    const char *names[] = {"depth", "normal", "albedo", "id", "rays"};
+    return names[static_cast<int>(a)];
+}
+
+// accepts a comma separated list of the names aov_name returns, or "all"
+inline bool parse_aovs(const char *text, aov_set &set)
+{
+    set = 0;
+    std::string list = text;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = std::min(list.find(',', start), list.size());
+        std::string name = list.substr(start, end - start);
+        bool known = false;
+        for (int i = 0; i < static_cast<int>(aov::count); i++)
+        {
+            if (name == aov_name(static_cast<aov>(i)) || name == "all")
+            {
+                set |= aov_bit(static_cast<aov>(i));
+                known = true;
+            }
+        }
+        if (!known)
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,440 @@
+#include "rtweekend.hh"
+
+#include "bvh.hh"
+#include "hittable_list.hh"
+#include "linear_bvh.hh"
+#include "material.hh"
+#include "packed_spheres.hh"
+#include "scene.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Micro benchmarks for the hot parts of the cpu renderer. Run without arguments for all of them or name the ones to run.
+
+static double seconds_since(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+// mix of coherent camera rays and incoherent bounce rays through the final scene
+static std::vector<ray> make_rays(int count, int grid)
+{
+    std::vector<ray> rays;
+    rays.reserve(count);
+    rng gen(42);
+    point3 lookfrom(13, 2, 3);
+    for (int i = 0; i < count; i++)
+    {
+        if (i % 2 == 0)
+        {
+            point3 target(random_double(gen, -4, 4), random_double(gen, -1, 2), random_double(gen, -2, 2));
+            rays.emplace_back(lookfrom, target - lookfrom);
+        }
+        else
+        {
+            point3 origin(random_double(gen, -grid, grid), random_double(gen, 0, 1), random_double(gen, -grid, grid));
+            rays.emplace_back(origin, random_unit_vector(gen));
+        }
+    }
+    return rays;
+}
+
+// traces all rays and returns rays/s, checksum receives the sum of all hit distances
+template <typename T>
+static double trace_all(const basic_hittable<T> &world, const std::vector<basic_ray<T>> &rays, double &checksum)
+{
+    checksum = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const auto &r : rays)
+    {
+        basic_hit_record<T> rec;
+        if (world.hit(r, basic_interval<T>(T(0.001), std::numeric_limits<T>::infinity()), rec))
+            checksum += rec.t;
+    }
+    return rays.size() / seconds_since(start);
+}
+
+static void bench_bvh(int ray_count)
+{
+    std::cout << "bvh: pointer-based bvh_node vs flattened linear_bvh\n";
+    std::cout << std::setw(10) << "spheres" << std::setw(14) << "structure" << std::setw(12) << "build ms"
+              << std::setw(12) << "Mrays/s" << std::setw(10) << "speedup" << "\n";
+
+    for (int grid : {11, 50})
+    {
+        hittable_list world = final_scene(grid);
+        auto rays = make_rays(ray_count, grid);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        bvh_node tree(world);
+        double tree_build = seconds_since(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        linear_bvh flat(world);
+        double flat_build = seconds_since(start);
+
+        double tree_sum, flat_sum;
+        double tree_rate = trace_all(tree, rays, tree_sum);
+        double flat_rate = trace_all(flat, rays, flat_sum);
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << std::setw(10) << world.objects.size() << std::setw(14) << "bvh_node" << std::setw(12) << tree_build * 1e3
+                  << std::setw(12) << tree_rate / 1e6 << std::setw(10) << 1.0 << "\n";
+        std::cout << std::setw(10) << world.objects.size() << std::setw(14) << "linear_bvh" << std::setw(12) << flat_build * 1e3
+                  << std::setw(12) << flat_rate / 1e6 << std::setw(10) << flat_rate / tree_rate << "\n";
+        if (std::fabs(tree_sum - flat_sum) > 1e-6 * std::fabs(tree_sum))
+            std::cout << "  warning: hit distances differ (" << tree_sum << " vs " << flat_sum << ")\n";
+    }
+}
+
+// intersects every ray with all spheres of the final scene in leaf sized groups: one sphere::hit after the other
+// against the packed kernels
+static void bench_spheres(int ray_count)
+{
+    hittable_list world = final_scene();
+    auto rays = make_rays(ray_count, 11);
+
+    std::vector<const sphere *> spheres;
+    packed_spheres packed;
+    for (const auto &object : world.objects)
+    {
+        auto s = dynamic_cast<const sphere *>(object.get());
+        spheres.push_back(s);
+        packed.add(s->center_point(), s->radius_length(), s->material_ptr());
+        if (spheres.size() % packed_spheres::group_size == 0)
+            packed.end_group();
+    }
+    packed.end_group();
+    const int count = static_cast<int>(spheres.size());
+    const int group = packed_spheres::group_size;
+
+    std::cout << "spheres: " << count << " spheres per ray in groups of " << group << ", "
+#if defined(PACKED_SPHERES_AVX2)
+              << "avx2"
+#elif defined(PACKED_SPHERES_SSE2)
+              << "sse2"
+#else
+              << "no simd"
+#endif
+              << " kernel\n";
+    std::cout << std::setw(16) << "kernel" << std::setw(14) << "Mtests/s" << std::setw(10) << "speedup" << "\n";
+
+    auto run = [&](const char *name, auto &&nearest_in_group, double baseline, double &checksum)
+    {
+        checksum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto &r : rays)
+        {
+            double closest = infinity;
+            for (int g = 0; g < count; g += group)
+                nearest_in_group(r, g, std::min(group, count - g), closest);
+            if (closest < infinity)
+                checksum += closest;
+        }
+        double rate = static_cast<double>(rays.size()) * count / seconds_since(start);
+        std::cout << std::fixed << std::setprecision(2) << std::setw(16) << name << std::setw(14) << rate / 1e6
+                  << std::setw(10) << (baseline > 0 ? rate / baseline : 1.0) << "\n";
+        return rate;
+    };
+
+    double hit_sum, scalar_sum, simd_sum;
+    double baseline = run("sphere::hit", [&](const ray &r, int first, int n, double &closest)
+                          {
+        hit_record rec;
+        for (int i = first; i < first + n; i++)
+            if (static_cast<const hittable *>(spheres[i])->hit(r, interval(0.001, closest), rec))
+                closest = rec.t; }, 0, hit_sum);
+    // packed indices: every group of the scene starts at a multiple of the group size
+    run("packed scalar", [&](const ray &r, int first, int n, double &closest)
+        {
+        double t;
+        if (packed.nearest_scalar(r, first, n, 0.001, closest, t) >= 0)
+            closest = t; }, baseline, scalar_sum);
+    run("packed simd", [&](const ray &r, int first, int n, double &closest)
+        {
+        double t;
+        if (packed.nearest(r, first, n, 0.001, closest, t) >= 0)
+            closest = t; }, baseline, simd_sum);
+
+    // fused multiply-adds (-march=native) may round the scalar versions a little differently
+    if (std::fabs(scalar_sum - hit_sum) > 1e-9 * std::fabs(hit_sum) || std::fabs(simd_sum - hit_sum) > 1e-9 * std::fabs(hit_sum))
+        std::cout << "  warning: hit distances differ (" << hit_sum << ", " << scalar_sum << ", " << simd_sum << ")\n";
+}
+
+// follows every ray for up to 10 bounces, returns paths/s. checksum receives the summed throughput of paths that
+// escaped to the sky
+template <typename World, typename Scatter>
+static double trace_paths(const World &world, const std::vector<ray> &rays, Scatter scatter_at, double &checksum)
+{
+    checksum = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        sampler gen(sampler_kind::independent, 7, i, 0, 1);
+        ray r = rays[i];
+        color throughput(1, 1, 1);
+        for (int depth = 0; depth < 10; depth++)
+        {
+            gen.start_bounce(depth);
+            hit_record rec;
+            if (!world.hit(r, interval(0.001, infinity), rec))
+            {
+                checksum += throughput.x() + throughput.y() + throughput.z();
+                break;
+            }
+            color attenuation;
+            ray scattered;
+            if (!scatter_at(*rec.mat, r, rec, attenuation, scattered, gen))
+                break;
+            throughput = throughput * attenuation;
+            r = scattered;
+        }
+    }
+    return rays.size() / seconds_since(start);
+}
+
+// whole paths through the default scene: virtual hit and scatter against the closed set of types with switch dispatch
+static void bench_dispatch(int ray_count)
+{
+    hittable_list world = final_scene();
+    linear_bvh bvh(world);
+    auto rays = make_rays(ray_count, 11);
+
+    std::cout << "dispatch: virtual calls vs closed set of scene types\n";
+    std::cout << std::setw(16) << "dispatch" << std::setw(14) << "Mpaths/s" << std::setw(10) << "speedup" << "\n";
+
+    double virtual_sum, closed_sum;
+    const hittable &any_world = bvh;
+    double virtual_rate = trace_paths(any_world, rays, [](const material &mat, const ray &r, const hit_record &rec, color &attenuation, ray &scattered, const sampler &gen)
+                                      { return mat.scatter(r, rec, attenuation, scattered, gen); }, virtual_sum);
+    double closed_rate = trace_paths(bvh, rays, [](const material &mat, const ray &r, const hit_record &rec, color &attenuation, ray &scattered, const sampler &gen)
+                                     { return scatter(mat, r, rec, attenuation, scattered, gen); }, closed_sum);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(16) << "virtual" << std::setw(14) << virtual_rate / 1e6 << std::setw(10) << 1.0 << "\n";
+    std::cout << std::setw(16) << "closed set" << std::setw(14) << closed_rate / 1e6 << std::setw(10) << closed_rate / virtual_rate << "\n";
+    if (virtual_sum != closed_sum)
+        std::cout << "  warning: results differ (" << virtual_sum << " vs " << closed_sum << ")\n";
+}
+
+// the same rays through the flattened bvh of the same scene stored in double and in single precision
+static void bench_precision(int ray_count)
+{
+    std::cout << "precision: linear_bvh in double vs float\n";
+    std::cout << std::setw(10) << "spheres" << std::setw(14) << "precision" << std::setw(12) << "Mrays/s"
+              << std::setw(10) << "speedup" << std::setw(14) << "rel. t diff" << "\n";
+
+    for (int grid : {11, 50})
+    {
+        basic_linear_bvh<double> wide(final_scene<double>(grid));
+        basic_linear_bvh<float> narrow(final_scene<float>(grid));
+        auto rays = make_rays(ray_count, grid);
+        std::vector<basic_ray<float>> float_rays;
+        float_rays.reserve(rays.size());
+        for (const auto &r : rays)
+            float_rays.emplace_back(basic_point3<float>(r.origin()), basic_vec3<float>(r.direction()));
+
+        double wide_sum, narrow_sum;
+        double wide_rate = trace_all(wide, rays, wide_sum);
+        double narrow_rate = trace_all(narrow, float_rays, narrow_sum);
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << std::setw(10) << final_scene(grid).objects.size() << std::setw(14) << "double" << std::setw(12)
+                  << wide_rate / 1e6 << std::setw(10) << 1.0 << std::setw(14) << "-" << "\n";
+        std::cout << std::setw(10) << final_scene(grid).objects.size() << std::setw(14) << "float" << std::setw(12)
+                  << narrow_rate / 1e6 << std::setw(10) << narrow_rate / wide_rate << std::setw(14) << std::scientific
+                  << std::setprecision(1) << std::fabs(narrow_sum - wide_sum) / wide_sum << "\n";
+    }
+}
+
+// throughput of the vector helpers of vec3.hh on vectors that stay in the l1 cache, in whichever storage this build uses
+template <typename T>
+static void bench_vec3_helpers(const char *precision, bool simd, int op_count)
+{
+    using vec = basic_vec3<T>;
+    constexpr int size = 1024;
+    std::vector<vec> a(size), b(size), out(size);
+    std::vector<T> scalars(size);
+    rng gen(3);
+    for (int i = 0; i < size; i++)
+    {
+        a[i] = unit_vector(vec::random(gen, -1, 1));
+        b[i] = unit_vector(vec::random(gen, -1, 1));
+    }
+    int rounds = std::max(1, op_count / size);
+
+    std::cout << precision << " (" << (simd ? "simd register" : "three scalars") << ", " << sizeof(vec) << " bytes)\n";
+    auto run = [&](const char *name, auto &&op)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int round = 0; round < rounds; round++)
+        {
+            // every round pairs the vectors differently, so no round repeats the work of the one before
+            for (int i = 0; i < size; i++)
+                op(i, (i + round) & (size - 1));
+        }
+        double rate = static_cast<double>(rounds) * size / seconds_since(start);
+        double check = 0;
+        for (int i = 0; i < size; i++)
+            check += out[i].x() + out[i].y() + out[i].z() + scalars[i];
+        std::cout << std::fixed << std::setprecision(1) << std::setw(16) << name << std::setw(12) << rate / 1e6
+                  << "  (" << std::setprecision(3) << check << ")\n";
+    };
+
+    std::cout << std::setw(16) << "helper" << std::setw(12) << "Mops/s" << "\n";
+    run("a + t * b", [&](int i, int j)
+        { out[i] = a[i] + T(0.5) * b[j]; });
+    run("dot", [&](int i, int j)
+        { scalars[i] += dot(a[i], b[j]); });
+    run("cross", [&](int i, int j)
+        { out[i] = cross(a[i], b[j]); });
+    run("unit_vector", [&](int i, int j)
+        { out[i] = unit_vector(a[i] + b[j]); });
+    run("reflect", [&](int i, int j)
+        { out[i] = reflect(a[i], b[j]); });
+    run("refract", [&](int i, int j)
+        { out[i] = refract(a[i], b[j], T(1) / T(1.5)); });
+}
+
+static void bench_vec3(int ray_count)
+{
+    std::cout << "vec3: vector helpers\n";
+#if defined(VEC3_SIMD_DOUBLE)
+    bench_vec3_helpers<double>("double", true, ray_count);
+#else
+    bench_vec3_helpers<double>("double", false, ray_count);
+#endif
+#if defined(VEC3_SIMD_FLOAT)
+    bench_vec3_helpers<float>("float", true, ray_count);
+#else
+    bench_vec3_helpers<float>("float", false, ray_count);
+#endif
+}
+
+// the pcg32 generator the renderer used before rng became counter-based, every thread kept one for the whole render
+class pcg32
+{
+public:
+    pcg32(uint64_t seed, uint64_t stream) : state(0), inc((stream << 1u) | 1u)
+    {
+        next_uint();
+        state += seed;
+        next_uint();
+    }
+
+    uint32_t next_uint()
+    {
+        uint64_t old_state = state;
+        state = old_state * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+        uint32_t rot = static_cast<uint32_t>(old_state >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+// random numbers per second with draws_per_sample numbers per pixel sample: one pcg32 for all samples against a new
+// counter-based rng or independent sampler for every sample as the camera makes them, from a key hashed once per
+// pixel of 16 samples
+static void bench_rng(int sample_count)
+{
+    std::cout << "rng: one pcg32 per thread vs counter-based rng and independent sampler per sample\n";
+    std::cout << std::setw(10) << "draws" << std::setw(14) << "generator" << std::setw(12) << "Mdraws/s" << std::setw(10)
+              << "speedup" << "\n";
+    for (int draws_per_sample : {4, 16, 64})
+    {
+        // best of alternating rounds, a single round is too short to be steady
+        double sum = 0, pcg_rate = 0, counter_rate = 0, sampler_rate = 0;
+        for (int round = 0; round < 5; round++)
+        {
+            pcg32 thread_gen(0, 0);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int sample = 0; sample < sample_count; sample++)
+                for (int d = 0; d < draws_per_sample; d++)
+                    sum += thread_gen.next_uint() * 0x1p-32;
+            pcg_rate = std::max(pcg_rate, static_cast<double>(sample_count) * draws_per_sample / seconds_since(start));
+
+            start = std::chrono::high_resolution_clock::now();
+            for (int pixel = 0; pixel < sample_count / 16; pixel++)
+            {
+                uint64_t key = rng::stream_key(0, pixel);
+                for (int sample = 0; sample < 16; sample++)
+                {
+                    rng gen = rng::for_sample(key, sample);
+                    for (int d = 0; d < draws_per_sample; d++)
+                        sum += random_double(gen);
+                }
+            }
+            counter_rate = std::max(counter_rate, static_cast<double>(sample_count) * draws_per_sample / seconds_since(start));
+
+            start = std::chrono::high_resolution_clock::now();
+            for (int pixel = 0; pixel < sample_count / 16; pixel++)
+            {
+                uint64_t key = sampler::key_of_pixel(0, pixel);
+                for (uint32_t sample = 0; sample < 16; sample++)
+                {
+                    sampler gen(sampler_kind::independent, key, sample, 16);
+                    for (int d = 0; d < draws_per_sample; d++)
+                        sum += gen.get_1d(d);
+                }
+            }
+            sampler_rate = std::max(sampler_rate, static_cast<double>(sample_count) * draws_per_sample / seconds_since(start));
+        }
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << std::setw(10) << draws_per_sample << std::setw(14) << "pcg32" << std::setw(12) << pcg_rate / 1e6
+                  << std::setw(10) << 1.0 << "\n";
+        std::cout << std::setw(10) << draws_per_sample << std::setw(14) << "counter" << std::setw(12) << counter_rate / 1e6
+                  << std::setw(10) << counter_rate / pcg_rate << "\n";
+        std::cout << std::setw(10) << draws_per_sample << std::setw(14) << "sampler" << std::setw(12) << sampler_rate / 1e6
+                  << std::setw(10) << sampler_rate / pcg_rate << "  (" << std::setprecision(1) << sum << ")\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int ray_count = 1000000;
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--rays") && i + 1 < argc)
+            ray_count = std::atoi(argv[++i]);
+        else
+            selected.push_back(argv[i]);
+    }
+
+    auto wanted = [&](const char *name)
+    {
+        if (selected.empty())
+            return true;
+        for (const auto &s : selected)
+            if (s == name)
+                return true;
+        return false;
+    };
+
+    if (wanted("bvh"))
+        bench_bvh(ray_count);
+    if (wanted("spheres"))
+        bench_spheres(ray_count / 10);
+    if (wanted("dispatch"))
+        bench_dispatch(ray_count);
+    if (wanted("precision"))
+        bench_precision(ray_count);
+    if (wanted("vec3"))
+        bench_vec3(ray_count * 10);
+    if (wanted("rng"))
+        bench_rng(ray_count * 4);
+
+    return 0;
+}
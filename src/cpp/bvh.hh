@@ -0,0 +1,172 @@
+#ifndef BVH_HH
+#define BVH_HH
+
+#include "rtweekend.hh"
+
+#include "hittable.hh"
+#include "hittable_list.hh"
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+// Partitions items [start, end) along the split with the lowest surface area heuristic cost and returns the split index.
+// box_of(item) gives the bounding box of an item, in either precision. If split_cost is given it receives the cost of the split relative to
+// intersecting every item of the node (an unsplit leaf costs end - start).
+template <typename T, typename BoxOf>
+size_t sah_partition(std::vector<T> &items, size_t start, size_t end, BoxOf box_of, double *split_cost = nullptr)
+{
+    constexpr int bin_count = 12; // number of buckets the sah is evaluated on per split
+    using box = std::decay_t<decltype(box_of(items[start]))>;
+
+    box bounds, centroid_bounds;
+    for (size_t i = start; i < end; i++)
+    {
+        auto item_box = box_of(items[i]);
+        auto c = item_box.centroid();
+        bounds = box(bounds, item_box);
+        centroid_bounds = box(centroid_bounds, box(c, c));
+    }
+
+    int axis = centroid_bounds.longest_axis();
+    auto extent = centroid_bounds.axis(axis);
+    size_t mid = start + (end - start) / 2;
+
+    auto centroid_on_axis = [&](const T &item)
+    { return box_of(item).centroid()[axis]; };
+
+    if (extent.size() > 0)
+    {
+        auto bin_of = [&](const T &item)
+        {
+            int b = static_cast<int>(bin_count * (centroid_on_axis(item) - extent.min) / extent.size());
+            return std::min(b, bin_count - 1);
+        };
+
+        // sort items into equally sized buckets along the axis
+        box bin_box[bin_count];
+        int bin_items[bin_count] = {};
+        for (size_t i = start; i < end; i++)
+        {
+            int b = bin_of(items[i]);
+            bin_box[b] = box(bin_box[b], box_of(items[i]));
+            bin_items[b]++;
+        }
+
+        // sweep from the right to get the area and count of everything right of each bucket boundary
+        double right_area[bin_count - 1];
+        int right_items[bin_count - 1];
+        box right_box;
+        int right_count = 0;
+        for (int b = bin_count - 1; b > 0; b--)
+        {
+            right_box = box(right_box, bin_box[b]);
+            right_count += bin_items[b];
+            right_area[b - 1] = right_box.surface_area();
+            right_items[b - 1] = right_count;
+        }
+
+        // sweep from the left and pick the boundary with the lowest cost, cost ~ area * items on both sides
+        box left_box;
+        int left_count = 0;
+        int best_split = -1;
+        double best_cost = infinity;
+        for (int b = 0; b < bin_count - 1; b++)
+        {
+            left_box = box(left_box, bin_box[b]);
+            left_count += bin_items[b];
+            if (left_count == 0 || right_items[b] == 0)
+                continue;
+
+            double cost = left_count * left_box.surface_area() + right_items[b] * right_area[b];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+
+        if (best_split >= 0)
+        {
+            if (split_cost)
+                *split_cost = bounds.surface_area() > 0 ? best_cost / bounds.surface_area() : double(end - start);
+            auto split = std::partition(items.begin() + start, items.begin() + end,
+                                        [&](const T &item)
+                                        { return bin_of(item) <= best_split; });
+            return split - items.begin();
+        }
+    }
+
+    // all centroids in one bucket (or on one spot): fall back to a median split, which does not save any work
+    if (split_cost)
+        *split_cost = double(end - start);
+    std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+                     [&](const T &a, const T &b)
+                     { return centroid_on_axis(a) < centroid_on_axis(b); });
+    return mid;
+}
+
+// bounding volume hierarchy: binary tree of bounding boxes, a ray only descends into the boxes it hits
+template <typename T>
+class basic_bvh_node : public basic_hittable<T>
+{
+public:
+    basic_bvh_node(const basic_hittable_list<T> &list)
+    {
+        // the build reorders the objects, so work on a copy
+        auto objects = list.objects;
+        build(objects, 0, objects.size());
+    }
+
+    bool hit(const basic_ray<T> &r, basic_interval<T> ray_t, basic_hit_record<T> &rec) const override
+    {
+        if (!bbox.hit(r, ray_t))
+            return false;
+
+        // the right child only needs to be closer than whatever the left child hit
+        bool hit_left = left->hit(r, ray_t, rec);
+        bool hit_right = right->hit(r, basic_interval<T>(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+
+        return hit_left || hit_right;
+    }
+
+    basic_aabb<T> bounding_box() const override { return bbox; }
+
+private:
+    shared_ptr<basic_hittable<T>> left;
+    shared_ptr<basic_hittable<T>> right;
+    basic_aabb<T> bbox;
+
+    basic_bvh_node(std::vector<shared_ptr<basic_hittable<T>>> &objects, size_t start, size_t end)
+    {
+        build(objects, start, end);
+    }
+
+    void build(std::vector<shared_ptr<basic_hittable<T>>> &objects, size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; i++)
+            bbox = basic_aabb<T>(bbox, objects[i]->bounding_box());
+
+        size_t object_span = end - start;
+        if (object_span == 1)
+        {
+            left = right = objects[start];
+            return;
+        }
+        if (object_span == 2)
+        {
+            left = objects[start];
+            right = objects[start + 1];
+            return;
+        }
+
+        size_t mid = sah_partition(objects, start, end, [](const shared_ptr<basic_hittable<T>> &object)
+                                   { return object->bounding_box(); });
+        left = shared_ptr<basic_bvh_node>(new basic_bvh_node(objects, start, mid));
+        right = shared_ptr<basic_bvh_node>(new basic_bvh_node(objects, mid, end));
+    }
+};
+
+using bvh_node = basic_bvh_node<double>;
+
+#endif
@@ -3,22 +3,40 @@
 
 #include "rtweekend.hh"
 
+#include "checkpoint.hh"
 #include "color.hh"
+#include "denoiser.hh"
 #include "hittable.hh"
+#include "image_writer.hh"
 #include "material.hh"
 #include "parallel.hh"
+#include "progress.hh"
+#include "sampler.hh"
+#include "scheduler.hh"
+#include "thread_pool.hh"
 
 #include <chrono>
 #include <iomanip>
-
-class camera
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// T is the precision the rays are traced in, the settings below are always given in double precision
+template <typename T>
+class basic_camera
 {
 public:
     double aspect_ratio = 1.0;                                 // Ratio of image width over height
     int image_height = 100;                                    // Rendered image width in pixel count
     int samples_per_pixel = 10;                                // Count of random samples for each pixel
     int max_depth = 10;                                        // Maximum bounces that are calculated for each ray
+    bool russian_roulette = false;                             // Randomly end dim paths early, the result stays unbiased
+    int roulette_min_depth = 3;                                // Bounces every path takes before russian roulette starts
     int processor_count = std::thread::hardware_concurrency(); // Maximum cores to use
+    thread_pool *pool = nullptr;                               // Workers to render with, threads are started per render if not set
+    uint64_t seed = 0;                                         // Seed of the random numbers used for sampling, the image only depends on it
+    sampler_kind sampling = sampler_kind::owen;                // How the samples of a pixel are spread (see sampler.hh)
 
     double vfov = 90;                  // vertical view angle (field of view)
     point3 lookfrom = point3(0, 0, 1); // where camera is looking "from"
@@ -28,7 +46,32 @@ public:
     double defocus_angle = 0; // Variation in angle of rays through each pixel
     double focus_dist = 10;   // Distance from Camera "Sensor" to plane of perfect focus (focal point)
 
-    void render(const hittable &world, double &last_render_time)
+    std::string output_file = "out.ppm"; // File the finished image is written to, nothing is written if empty
+    render_progress *progress = nullptr; // Optional, lets the caller poll the progress of the render or cancel it
+
+    schedule_mode schedule = schedule_mode::lines; // How the image is split up between the threads
+    int tile_size = 32;                            // Edge length of a tile in pixels (tile scheduling only)
+    tile_order tile_ordering = tile_order::morton; // Order the tiles are dealt out in (tile scheduling only)
+
+    bool progressive = false;              // Render one sample per pixel per pass and publish the image after every pass
+    render_snapshot *snapshot = nullptr;   // Optional, receives the image after every pass, so also the finished one
+
+    bool adaptive = false;           // Spend the samples on the pixels that are still noisy instead of evenly
+    int adaptive_min_samples = 8;    // Samples every pixel gets before it may count as converged (adaptive only)
+    double adaptive_threshold = 0.02; // Relative standard error of the luminance below which a pixel is done (adaptive only)
+    std::string sample_map_file;     // Optional, writes the samples taken per pixel as pgm (adaptive only)
+
+    bool denoise = false; // Filter the finished image (and every snapshot) guided by the first hits of the camera rays
+    aov_set aovs = 0;     // Extra channels written next to output_file, each to a file of its own (see aov.hh)
+
+    std::string checkpoint_file;     // Optional, the state of the render is saved there between passes (see checkpoint.hh)
+    double checkpoint_interval = 60; // Seconds between checkpoints, the finished render is always saved
+    bool resume = false;             // Continue from checkpoint_file if it exists, samples_per_pixel may have grown
+
+    // World is the concrete type of the scene (e.g. linear_bvh), so ray_color calls its hit directly. Any hittable works.
+    // Returns false if the render could not start or a file could not be written, a cancelled render is not a failure.
+    template <typename World>
+    bool render(const World &world, double &last_render_time)
     {
         std::clog << "Starting render ...\n";
         // start timer
@@ -39,26 +82,182 @@ public:
 
         std::clog << "Render Resolution: " << image_width << "x" << image_height << std::endl;
 
-        // create shared memory object with task queue
-        image_memory image(image_width, image_height);
+        // create shared image memory, it accumulates the samples of all passes. The denoiser estimates the noise from
+        // the luminance like adaptive sampling does and needs the first hits as guides.
+        aov_set tracked = (output_file.empty() ? 0 : aovs) | (denoise ? denoiser_guides : 0);
+        basic_image_memory<T> image(image_width, image_height, adaptive || denoise, tracked);
+
+        bool own_pool = !pool || pool->size() == 0;
+        thread_pool local_pool(own_pool ? processor_count : 0);
+        thread_pool &workers = own_pool ? local_pool : *pool;
+
+        // a resumed render continues with the sums and sample counts of the checkpoint
+        checkpoint_header checkpoint = make_checkpoint_header(tracked);
+        int samples_done = 0;
+        int64_t pixel_count = static_cast<int64_t>(image_width) * image_height;
+        std::atomic<int64_t> samples_taken{0};
+        if (resume && !checkpoint_file.empty())
+        {
+            checkpoint_header saved;
+            std::vector<uint8_t> state;
+            checkpoint_status status = read_checkpoint(checkpoint_file, checkpoint, image.state_size(), saved, state);
+            if (status == checkpoint_status::mismatch || (status == checkpoint_status::loaded &&
+                                                          !image.load_state(state.data(), state.size(), &workers)))
+            {
+                // rendering anyway would overwrite the checkpoint of the other render
+                std::cerr << "Checkpoint " << checkpoint_file << " is damaged or belongs to a render with other settings"
+                          << (sampling == sampler_kind::stratified ? " (stratified renders can't change the samples per pixel)" : "")
+                          << ", not rendering.\n";
+                last_render_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+                return false;
+            }
+            if (status == checkpoint_status::loaded)
+            {
+                samples_done = saved.samples_done;
+                samples_taken = saved.samples_taken;
+                std::clog << "Resuming from " << checkpoint_file << " after " << samples_done << " samples per pixel.\n";
+            }
+        }
 
-        // open threads and start rendering
-        std::thread threads[processor_count];
-        for (int i = 0; i < processor_count; i++)
+        // A progressive render takes one sample per pixel in every pass, so there is a complete image after each pass.
+        // A checkpointed render takes passes of checkpoint_batch samples, checkpoints are written between passes.
+        render_pass pass_settings;
+        int batch = progressive ? 1 : checkpoint_file.empty() ? samples_per_pixel : std::min(checkpoint_batch, samples_per_pixel);
+        int passes = (std::max(0, samples_per_pixel - samples_done) + batch - 1) / batch;
+        pass_settings.track_luminance = adaptive || denoise;
+        pass_settings.aovs = tracked;
+
+        // an adaptive render first gives every pixel the minimum samples, then keeps sampling the unconverged pixels in
+        // small batches until the samples of an evenly sampled image are used up
+        if (adaptive)
         {
-            threads[i] = std::thread(&camera::render_thread, this, std::ref(world), std::ref(image));
+            pass_settings.samples = std::max(1, std::min(adaptive_min_samples, samples_per_pixel));
+            pass_settings.sample_budget = pixel_count * samples_per_pixel;
+            pass_settings.samples_taken = &samples_taken;
+            passes = std::numeric_limits<int>::max();
+            if (samples_taken.load() > 0 && !plan_adaptive_pass(image, pass_settings)) // resumed after the first pass
+                passes = 0;
         }
-        // wait for all threads to finish
-        for (int i = 0; i < processor_count; i++)
+
+        // the scheduler splits the work of one pass between the threads
+        auto scheduler = make_scheduler();
+
+        render_progress local_progress;
+        render_progress &current_progress = progress ? *progress : local_progress;
+        current_progress.start(adaptive ? adaptive_progress_steps : passes * scheduler->size());
+        current_progress.samples_done.store(samples_done, std::memory_order_relaxed);
+
+        std::vector<std::chrono::high_resolution_clock::time_point> finish_times(processor_count);
+        double tail = 0;
+        checkpoint_writer checkpoints;
+        auto last_checkpoint = start;
+        denoise_frame denoised;
+        int denoised_samples = -1; // samples per pixel of the image in denoised
+        double denoise_time = 0;
         {
-            threads[i].join();
+            progress_reporter reporter(current_progress); // prints the progress until the threads are done
+
+            for (int pass = 0; pass < passes; pass++)
+            {
+                if (pass > 0)
+                    scheduler = make_scheduler();
+                if (!adaptive)
+                    pass_settings.samples = std::min(batch, samples_per_pixel - samples_done);
+
+                // render on every worker of the pool and wait for all of them to finish
+                workers.run([&](int thread_index)
+                            { render_thread(world, image, *scheduler, pass_settings, thread_index, current_progress,
+                                            finish_times[thread_index]); });
+                if (adaptive)
+                    samples_done = static_cast<int>(samples_taken.load() / pixel_count); // mean samples per pixel
+                else
+                    samples_done += pass_settings.samples;
+                current_progress.samples_done.store(samples_done, std::memory_order_relaxed);
+
+                // time between the first thread running out of work and the last one finishing
+                auto first_done = *std::min_element(finish_times.begin(), finish_times.end());
+                auto last_done = *std::max_element(finish_times.begin(), finish_times.end());
+                tail += std::chrono::duration<double>(last_done - first_done).count();
+
+                if (current_progress.cancelled())
+                    break;
+
+                auto now = std::chrono::high_resolution_clock::now();
+                if (!checkpoint_file.empty() && std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_interval)
+                {
+                    save_checkpoint(image, checkpoint, samples_done, adaptive ? samples_taken.load() : pixel_count * samples_done, workers, checkpoints);
+                    last_checkpoint = now;
+                }
+
+                if (snapshot)
+                {
+                    if (denoise)
+                    {
+                        denoise_time = denoise_image(image, workers, denoised);
+                        denoised_samples = samples_done;
+                    }
+                    publish_snapshot(image, samples_done, denoise ? &denoised : nullptr, denoise_time, workers);
+                }
+
+                if (current_progress.stop_requested.load(std::memory_order_relaxed))
+                    break;
+
+                if (adaptive && !plan_adaptive_pass(image, pass_settings))
+                    break;
+            }
         }
+        current_progress.finish();
 
-        std::clog << "\nRender Done.\n";
-        std::clog << "Writing...\n";
+        if (current_progress.cancelled())
+        {
+            // the image is incomplete, nothing is written or published
+            std::clog << "\nRender cancelled.\n";
+            last_render_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            return true;
+        }
 
-        // store image to file
-        write_color(image.get_image(), image_width, image_height, samples_per_pixel);
+        std::clog << "\nRender Done";
+        if (adaptive)
+            std::clog << " (" << std::fixed << std::setprecision(2) << static_cast<double>(samples_taken.load()) / pixel_count
+                      << " samples per pixel on average)";
+        else if (samples_done < samples_per_pixel)
+            std::clog << " (stopped after " << samples_done << " of " << samples_per_pixel << " samples per pixel)";
+        std::clog << ".\n";
+        std::clog << "Idle tail (first to last thread done): " << std::fixed << std::setprecision(3) << tail << " seconds.\n";
+        // the last checkpoint holds the finished image, a later render can resume from it to add samples
+        if (!checkpoint_file.empty())
+            save_checkpoint(image, checkpoint, samples_done, adaptive ? samples_taken.load() : pixel_count * samples_done, workers, checkpoints);
+        if (denoise)
+        {
+            if (denoised_samples != samples_done) // a snapshot already holds the denoised image of the last pass
+                denoise_time = denoise_image(image, workers, denoised);
+            std::clog << "Denoised in " << std::fixed << std::setprecision(3) << denoise_time << " seconds.\n";
+        }
+        // store image to file, every file is tried even if an earlier one failed
+        bool written = true;
+        if (!output_file.empty())
+        {
+            std::clog << "Writing...\n";
+            if (denoise)
+                written = write_image(output_file, to_colors(denoised).data(), image_width, image_height, &workers);
+            else if constexpr (std::is_same_v<T, double>)
+                written = write_image(output_file, image.get_image(), image_width, image_height, &workers);
+            else
+                written = write_image(output_file, widen(image.get_image(), static_cast<size_t>(pixel_count)).data(), image_width, image_height, &workers);
+
+            for (int i = 0; i < static_cast<int>(aov::count); i++)
+            {
+                aov a = static_cast<aov>(i);
+                if (!has_aov(aovs, a))
+                    continue;
+                const float *planes[3];
+                for (int c = 0; c < aov_channels(a); c++)
+                    planes[c] = image.get_aov(a, c);
+                written = write_aov(aov_filename(output_file, a), a, planes, image_width, image_height, &workers) && written;
+            }
+        }
+        if (adaptive && !sample_map_file.empty())
+            written = write_sample_map(sample_map_file, image.get_sample_counts(), image_width, image_height) && written;
 
         // stop timer
         auto stop = std::chrono::high_resolution_clock::now();
@@ -66,28 +265,55 @@ public:
         last_render_time = elapsed.count();
 
         std::clog << "Done in " << std::fixed << std::setprecision(2) << elapsed.count() << " seconds.\n";
+        return written;
     }
 
 private:
-    int image_width;      // Rendered image width
-    point3 camera_center; // Camera center
-    point3 pixel00_loc;   // Location of pixel 0, 0
-    vec3 pixel_delta_u;   // Offset to pixel to the right
-    vec3 pixel_delta_v;   // Offset to pixel below
-    vec3 u, v, w;         // Camera frame basis vectors
-    vec3 defocus_disk_u;  // Defocus disk horizontal radius
-    vec3 defocus_disk_v;  // Defocus disk vertical radius
+    using vec3_t = basic_vec3<T>;
+    using point3_t = basic_point3<T>;
+    using color_t = basic_color<T>;
+    using ray_t = basic_ray<T>;
+
+    int image_width;        // Rendered image width
+    point3_t camera_center; // Camera center
+    point3_t pixel00_loc;   // Location of pixel 0, 0
+    vec3_t pixel_delta_u;   // Offset to pixel to the right
+    vec3_t pixel_delta_v;   // Offset to pixel below
+    vec3_t defocus_disk_u;  // Defocus disk horizontal radius
+    vec3_t defocus_disk_v;  // Defocus disk vertical radius
+    atrous_denoiser denoiser; // keeps its buffers between the snapshots of a render
+
+    static constexpr double roulette_min_survival = 0.05; // keeps the weight of surviving paths bounded
+    static constexpr int adaptive_progress_steps = 1000; // adaptive renders report progress in permille of the budget
+    static constexpr int adaptive_max_factor = 8;        // no pixel takes more than this many times samples_per_pixel
+    static constexpr int checkpoint_batch = 16;         // samples per pixel of every pass of a checkpointed render
+    static constexpr aov_set denoiser_guides = aov_bit(aov::depth) | aov_bit(aov::normal) | aov_bit(aov::albedo);
+
+    // what every pixel of one pass gets
+    struct render_pass
+    {
+        int samples = 1;                            // samples per pixel
+        bool skip_converged = false;                // leave out pixels that are converged (adaptive only)
+        bool track_luminance = false;               // adds the luminance of the samples to the image (adaptive or denoising)
+        aov_set aovs = 0;                           // aovs the image keeps, requested or needed by the denoiser
+        std::atomic<int64_t> *samples_taken = nullptr; // counts the samples of all passes (adaptive only)
+        int64_t sample_budget = 0;                  // samples the whole render may take (adaptive only)
+    };
 
     void initialize()
     {
         image_width = std::ceil(image_height * aspect_ratio);
         image_width = image_width >= 1 ? image_width : 1;
 
-        // Read number of available processors
+        // the pool decides how many threads actually render. Without workers (an empty pool, or hardware_concurrency()
+        // reporting 0) the render gets a thread of its own, a pool of size 0 would never run the job.
+        if (pool && pool->size() > 0)
+            processor_count = pool->size();
+        processor_count = std::max(1, processor_count);
         std::clog << "Using " << processor_count << " threads.\n";
 
-        // Camera/viewport settings
-        camera_center = lookfrom;
+        // Camera/viewport settings, worked out in double precision and only then stored in T
+        point3 center = lookfrom;
 
         auto theta = degrees_to_radians(vfov);
         auto h = tan(theta / 2);
@@ -95,96 +321,364 @@ private:
         auto viewport_width = viewport_height * (static_cast<double>(image_width) / image_height);
 
         // Calculate the u,v,w unit basis vectors for the camera coordinate frame.
-        w = unit_vector(lookfrom - lookat);
-        u = unit_vector(cross(vup, w));
-        v = cross(w, u);
+        vec3 w = unit_vector(lookfrom - lookat);
+        vec3 u = unit_vector(cross(vup, w));
+        vec3 v = cross(w, u);
 
         // calculate vectors that "span" the viewport plane
         auto viewport_u = viewport_width * u;   // vector along horizontal edge
         auto viewport_v = viewport_height * -v; // vector down vertical edge
 
         // calculate distances between pixels
-        pixel_delta_u = viewport_u / image_width;
-        pixel_delta_v = viewport_v / image_height;
+        vec3 delta_u = viewport_u / image_width;
+        vec3 delta_v = viewport_v / image_height;
 
         // calculate position from first pixel (upper left) and from viewport top left corner
-        auto viewport_upper_left = camera_center - (focus_dist * w) - (viewport_u + viewport_v) / 2;
-        pixel00_loc = viewport_upper_left + (pixel_delta_u + pixel_delta_v) / 2;
+        auto viewport_upper_left = center - (focus_dist * w) - (viewport_u + viewport_v) / 2;
+        auto pixel00 = viewport_upper_left + (delta_u + delta_v) / 2;
 
         // calculate defocus disk basis vectors
         auto defocus_radius = focus_dist * tan(degrees_to_radians(defocus_angle / 2));
-        defocus_disk_u = defocus_radius * u;
-        defocus_disk_v = defocus_radius * v;
+
+        camera_center = point3_t(center);
+        pixel00_loc = point3_t(pixel00);
+        pixel_delta_u = vec3_t(delta_u);
+        pixel_delta_v = vec3_t(delta_v);
+        defocus_disk_u = vec3_t(defocus_radius * u);
+        defocus_disk_v = vec3_t(defocus_radius * v);
     }
 
-    // Renders the image as long as there are lines left to render
-    void render_thread(const hittable &world, image_memory &image)
+    std::unique_ptr<render_scheduler> make_scheduler() const
     {
-        int j;
-        while ((j = image.get_render_line()) <= image_height)
-        {
+        if (schedule == schedule_mode::lines)
+            return std::make_unique<line_scheduler>(image_width, image_height);
+        return std::make_unique<tile_scheduler>(image_width, image_height, tile_size, tile_ordering, processor_count);
+    }
 
-            for (int i = 0; i < image_width; ++i)
+    // what the camera ray of a sample hits first and what the sample cost, for the aovs and the denoiser
+    struct sample_record
+    {
+        color_t albedo;     // attenuation of the surface, or the sky color
+        vec3_t normal;      // facing the ray, 0 for the sky
+        T depth = 0;        // distance from the ray origin, 0 for the sky
+        int object_id = -1; // index of the object in the scene, -1 for the sky
+        int rays = 0;       // rays traced: the camera ray and every bounce
+    };
+
+    // copies the mean of the samples and the guides of every pixel into frame and denoises it on all workers, returns
+    // the seconds the denoiser took
+    double denoise_image(const basic_image_memory<T> &image, thread_pool &workers, denoise_frame &frame)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        frame.resize(image_width, image_height);
+        for_each_line(image_height, &workers, [&](int j)
+                      {
+            for (int i = 0; i < image_width; i++)
+            {
+                size_t p = static_cast<size_t>(j) * image_width + i;
+                T scale = T(1) / std::max(1, image.samples(j, i));
+                color_t mean = scale * image.pixel(j, i);
+                for (int c = 0; c < 3; c++)
+                {
+                    frame.color[c][p] = static_cast<float>(mean[c]);
+                    frame.albedo[c][p] = static_cast<float>(scale) * image.aov_value(aov::albedo, c, j, i);
+                    frame.normal[c][p] = image.aov_value(aov::normal, c, j, i); // only the direction matters
+                }
+                frame.depth[p] = static_cast<float>(scale) * image.aov_value(aov::depth, 0, j, i);
+                frame.variance[p] = static_cast<float>(image.luminance_variance(j, i));
+            } });
+        denoiser.denoise(frame, &workers);
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // converts the accumulated samples, or the denoised image if there is one, to a displayable image on all workers
+    // and hands it to the snapshot
+    void publish_snapshot(const basic_image_memory<T> &image, int samples, const denoise_frame *denoised,
+                          double denoise_time, thread_pool &workers) const
+    {
+        std::vector<uint8_t> rgba(4 * static_cast<size_t>(image_width) * image_height);
+        int thread_count = workers.size() > 0 ? workers.size() : 1;
+        workers.run([&](int thread_index)
+                    {
+            for (int j = thread_index; j < image_height; j += thread_count)
             {
-                color pixel_color = color(0, 0, 0);
-                for (int sample = 0; sample < samples_per_pixel; sample++)
+                uint8_t *line = &rgba[4 * static_cast<size_t>(j) * image_width];
+                for (int i = 0; i < image_width; i++)
                 {
-                    ray r = get_ray(i, j);                         // get a slightly randomized ray for the current pixel
-                    pixel_color += ray_color(r, max_depth, world); // calculate color for the current pixel
+                    color c;
+                    if (denoised)
+                    {
+                        size_t p = static_cast<size_t>(j) * image_width + i;
+                        c = color(denoised->color[0][p], denoised->color[1][p], denoised->color[2][p]);
+                    }
+                    else
+                        c = (1.0 / std::max(1, image.samples(j, i))) * color(image.pixel(j, i));
+                    line[4 * i + 0] = component_to_byte(c.x());
+                    line[4 * i + 1] = component_to_byte(c.y());
+                    line[4 * i + 2] = component_to_byte(c.z());
+                    line[4 * i + 3] = 255;
+                }
+            } });
+
+        std::lock_guard<std::mutex> guard(snapshot->lock);
+        snapshot->rgba.swap(rgba);
+        snapshot->width = image_width;
+        snapshot->height = image_height;
+        snapshot->samples = samples;
+        snapshot->denoise_time = denoise_time;
+        snapshot->version.fetch_add(1, std::memory_order_release);
+    }
+
+    // Spreads the rest of the budget of an adaptive render over the pixels that still need samples, false once every
+    // pixel has converged or there is not enough budget left for one more sample each
+    bool plan_adaptive_pass(const basic_image_memory<T> &image, render_pass &pass) const
+    {
+        int64_t remaining = pass.sample_budget - pass.samples_taken->load();
+        int64_t unconverged = count_unconverged(image);
+        if (unconverged == 0 || remaining < unconverged)
+            return false;
+        pass.samples = static_cast<int>(std::min<int64_t>(std::max(1, adaptive_min_samples / 2), remaining / unconverged));
+        pass.skip_converged = true;
+        return true;
+    }
+
+    // everything that decides what the samples of this render return
+    checkpoint_header make_checkpoint_header(aov_set tracked) const
+    {
+        checkpoint_header header;
+        header.width = image_width;
+        header.height = image_height;
+        header.precision = sizeof(T);
+        header.max_depth = max_depth;
+        header.russian_roulette = russian_roulette;
+        header.roulette_min_depth = roulette_min_depth;
+        header.sampling = static_cast<int32_t>(sampling);
+        header.aovs = tracked;
+        header.track_luminance = adaptive || denoise;
+        header.strata = sampling == sampler_kind::stratified ? samples_per_pixel : 0;
+        header.seed = seed;
+        const double camera[12] = {lookfrom.x(), lookfrom.y(), lookfrom.z(), lookat.x(), lookat.y(), lookat.z(),
+                                   vup.x(), vup.y(), vup.z(), vfov, defocus_angle, focus_dist};
+        std::copy(camera, camera + 12, header.camera);
+        return header;
+    }
+
+    // copies the image state on all workers and hands it to the writer thread, the next pass starts right away
+    void save_checkpoint(const basic_image_memory<T> &image, checkpoint_header header, int samples_done,
+                         int64_t samples_taken, thread_pool &workers, checkpoint_writer &writer) const
+    {
+        header.samples_done = samples_done;
+        header.samples_taken = samples_taken;
+        std::vector<uint8_t> &state = writer.state();
+        state.resize(image.state_size());
+        image.save_state(state.data(), &workers);
+        writer.write(checkpoint_file, header);
+    }
+
+    // a pixel needs no more samples once its noise is below the threshold or it took its share many times over
+    bool converged(const basic_image_memory<T> &image, int j, int i) const
+    {
+        return image.samples(j, i) >= adaptive_max_factor * samples_per_pixel ||
+               image.relative_error(j, i) < adaptive_threshold;
+    }
+
+    int64_t count_unconverged(const basic_image_memory<T> &image) const
+    {
+        int64_t count = 0;
+        for (int j = 0; j < image_height; j++)
+            for (int i = 0; i < image_width; i++)
+                count += !converged(image, j, i);
+        return count;
+    }
+
+    // Renders the image as long as the scheduler has work left
+    template <typename World>
+    void render_thread(const World &world, basic_image_memory<T> &image, render_scheduler &scheduler, const render_pass &pass,
+                       int thread_index, render_progress &thread_progress,
+                       std::chrono::high_resolution_clock::time_point &finish_time)
+    {
+        render_tile tile;
+        while (!thread_progress.cancelled() && scheduler.next(thread_index, tile)) // a cancelled render stops between tiles
+        {
+            int64_t tile_samples = 0;
+            for (int j = tile.y0; j < tile.y1; ++j)
+            {
+                for (int i = tile.x0; i < tile.x1; ++i)
+                {
+                    if (pass.skip_converged && converged(image, j, i))
+                        continue;
+
+                    color_t pixel_color = color_t(0, 0, 0);
+                    T luminance_sum = 0, luminance_squared = 0;
+                    sample_record record_sum; // the object id is that of the first sample
+                    int first_sample = image.samples(j, i); // samples of earlier passes, only this thread adds to the pixel
+                    uint64_t pixel_key = sampler::key_of_pixel(seed, static_cast<uint64_t>(j) * image_width + i);
+                    for (int sample = 0; sample < pass.samples; sample++)
+                    {
+                        sampler gen(sampling, pixel_key, first_sample + sample, samples_per_pixel);
+                        ray_t r = get_ray(i, j, gen);                        // get a slightly randomized ray for the current pixel
+                        sample_record record;
+                        color_t sample_color = ray_color(r, max_depth, world, gen, color_t(1, 1, 1), pass.aovs ? &record : nullptr); // calculate color for the current pixel
+                        pixel_color += sample_color;
+                        if (pass.aovs)
+                        {
+                            record_sum.albedo += record.albedo;
+                            record_sum.normal += record.normal;
+                            record_sum.depth += record.depth;
+                            record_sum.rays += record.rays;
+                            if (first_sample + sample == 0)
+                                record_sum.object_id = record.object_id;
+                        }
+                        if (pass.track_luminance)
+                        {
+                            T l = luminance(sample_color);
+                            luminance_sum += l;
+                            luminance_squared += l * l;
+                        }
+                    }
+                    image.add_to_pixel(j, i, pixel_color, pass.samples); // add the samples to the image
+                    if (pass.track_luminance)
+                        image.add_luminance(j, i, luminance_sum, luminance_squared);
+                    if (pass.aovs)
+                        add_aovs(image, j, i, record_sum, first_sample == 0);
+                    tile_samples += pass.samples;
                 }
-                image.write_pixel(j, i, pixel_color); // write the color to the image
             }
+
+            if (pass.samples_taken)
+            {
+                int64_t taken = pass.samples_taken->fetch_add(tile_samples, std::memory_order_relaxed) + tile_samples;
+                int permille = static_cast<int>(std::min<int64_t>(adaptive_progress_steps, adaptive_progress_steps * taken / pass.sample_budget));
+                thread_progress.work_done.store(permille, std::memory_order_relaxed);
+            }
+            else
+                thread_progress.work_done.fetch_add(1, std::memory_order_relaxed);
         }
+        finish_time = std::chrono::high_resolution_clock::now();
     }
 
-    ray get_ray(int i, int j) const
+    // adds the records of the samples of one pass to the aovs the image tracks, the object id is only set by the pass
+    // that took the first sample
+    static void add_aovs(basic_image_memory<T> &image, int j, int i, const sample_record &sum, bool first_pass)
+    {
+        if (image.tracks(aov::depth))
+            image.aov_value(aov::depth, 0, j, i) += static_cast<float>(sum.depth);
+        for (int c = 0; c < 3; c++)
+        {
+            if (image.tracks(aov::normal))
+                image.aov_value(aov::normal, c, j, i) += static_cast<float>(sum.normal[c]);
+            if (image.tracks(aov::albedo))
+                image.aov_value(aov::albedo, c, j, i) += static_cast<float>(sum.albedo[c]);
+        }
+        if (image.tracks(aov::object_id) && first_pass)
+            image.aov_value(aov::object_id, 0, j, i) = static_cast<float>(sum.object_id);
+        if (image.tracks(aov::ray_count))
+            image.aov_value(aov::ray_count, 0, j, i) += static_cast<float>(sum.rays);
+    }
+
+    ray_t get_ray(int i, int j, const sampler &gen) const
     {
         // Get a randomly sampled camera ray for the pixel at location i,j originating from a random point on the defocus disk.
         auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
-        auto pixel_sample = pixel_center + pixel_sample_square();
+        auto pixel_sample = pixel_center + pixel_sample_square(gen);
 
-        auto ray_origin = (defocus_angle <= 0) ? camera_center : defocus_disc_sample();
+        auto ray_origin = (defocus_angle <= 0) ? camera_center : defocus_disc_sample(gen);
         auto ray_direction = pixel_sample - ray_origin;
 
-        return ray(ray_origin, ray_direction);
+        return ray_t(ray_origin, ray_direction);
     }
 
-    point3 defocus_disc_sample() const
+    point3_t defocus_disc_sample(const sampler &gen) const
     {
         // returns a random point on the defocus disk
-        auto p = random_in_unit_disk();
+        sample_2d u = gen.get_2d(sampler::lens);
+        auto p = in_unit_disk_from<T>(u.x, u.y);
         return camera_center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    vec3 pixel_sample_square() const
+    vec3_t pixel_sample_square(const sampler &gen) const
     {
         // returns a random point in the surrounding square
-        auto px = -0.5 + random_double();
-        auto py = -0.5 + random_double();
+        sample_2d u = gen.get_2d(sampler::pixel);
+        T px = static_cast<T>(-0.5 + u.x);
+        T py = static_cast<T>(-0.5 + u.y);
         return (px * pixel_delta_u) + (py * pixel_delta_v);
     }
 
-    color ray_color(const ray &r, int depth, const hittable &world) const
+    // throughput is the product of all attenuations along the path so far, it only drives russian roulette. record is
+    // optional, it receives what the camera ray hits and counts the rays of the whole path.
+    template <typename World>
+    color_t ray_color(const ray_t &r, int depth, const World &world, sampler &gen, const color_t &throughput,
+                      sample_record *record = nullptr) const
     {
-        hit_record rec;
+        basic_hit_record<T> rec;
 
         // If we've exceeded the ray bounce limit, no more light is gathered.
         if (depth <= 0)
-            return color(0, 0, 0);
+            return color_t(0, 0, 0);
+
+        bool camera_ray = record && depth == max_depth;
+        if (record)
+            record->rays++;
 
-        if (world.hit(r, interval(0.001, infinity), rec))
+        // no minimum distance: scattered rays start off the surface they leave (see basic_hit_record::spawn_ray)
+        if (world.hit(r, basic_interval<T>(0, std::numeric_limits<T>::infinity()), rec))
         { // check if ray hits any objects
-            ray scattered;
-            color attenuation;
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
-                return attenuation * ray_color(scattered, depth - 1, world);
-            return color(0, 0, 0);
+            ray_t scattered;
+            color_t attenuation;
+            gen.start_bounce(max_depth - depth);
+            bool scatters = scatter(*rec.mat, r, rec, attenuation, scattered, gen);
+            if (camera_ray)
+            {
+                record->albedo = attenuation;
+                record->normal = rec.normal;
+                record->depth = rec.t * r.direction().length();
+                record->object_id = rec.object_id;
+            }
+            if (scatters)
+            {
+                color_t path_throughput = throughput * attenuation;
+                if (russian_roulette && max_depth - depth >= roulette_min_depth)
+                {
+                    // continue dim paths only with a probability matching their brightness and weight the survivors up,
+                    // the expected value stays the same
+                    double survival = std::min(1.0, std::max(roulette_min_survival, static_cast<double>(max_component(path_throughput))));
+                    if (gen.get_1d(sampler::roulette) >= survival)
+                        return color_t(0, 0, 0);
+                    attenuation /= static_cast<T>(survival);
+                }
+                return attenuation * ray_color(scattered, depth - 1, world, gen, path_throughput, record);
+            }
+            return color_t(0, 0, 0);
         }
 
-        vec3 unit_direction = unit_vector(r.direction());                   // normalize ray direction
-        auto a = 0.5 * (unit_direction.y() + 1.0);                          // scale y component of ray direction to [0, 1] (creates a fade from blue to white)
-        return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0); // 1,1,1 is start color and 0.5,0.7,1.0 is end color
+        vec3_t unit_direction = unit_vector(r.direction());                     // normalize ray direction
+        T a = T(0.5) * (unit_direction.y() + 1);                                // scale y component of ray direction to [0, 1] (creates a fade from blue to white)
+        color_t sky = (1 - a) * color_t(1.0, 1.0, 1.0) + a * color_t(0.5, 0.7, 1.0); // 1,1,1 is start color and 0.5,0.7,1.0 is end color
+        if (camera_ray)
+            record->albedo = sky;
+        return sky;
+    }
+
+    // the denoised planes as the double precision colors the image writers take
+    static std::vector<color> to_colors(const denoise_frame &frame)
+    {
+        std::vector<color> colors(frame.color[0].size());
+        for (size_t p = 0; p < colors.size(); p++)
+            colors[p] = color(frame.color[0][p], frame.color[1][p], frame.color[2][p]);
+        return colors;
+    }
+
+    // the image writers take double precision colors, a single precision image is widened just for writing
+    static std::vector<color> widen(const color_t *image, size_t count)
+    {
+        std::vector<color> wide(count);
+        for (size_t i = 0; i < count; i++)
+            wide[i] = color(image[i]);
+        return wide;
     }
 };
 
+using camera = basic_camera<double>;
+
 #endif
\ No newline at end of file
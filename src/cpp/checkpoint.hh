@@ -0,0 +1,135 @@
+#ifndef CHECKPOINT_HH
+#define CHECKPOINT_HH
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What a checkpoint file starts with, the image state of basic_image_memory follows directly (native byte order). The
+// random numbers of a sample only depend on the seed, the sampler, the pixel and the sample index (see sampler.hh),
+// and for the stratified sampler on the samples per pixel it spreads its strata over. With those the sample counts in
+// the image state are the whole position of the random numbers. A render can resume from a checkpoint if everything
+// that decides what a sample returns matches, it may ask for more samples than before unless it is stratified.
+struct checkpoint_header
+{
+    char magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '0', '2'};
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t precision = 0; // bytes of a sum, 8 for double and 4 for single precision renders
+    int32_t max_depth = 0;
+    int32_t russian_roulette = 0;
+    int32_t roulette_min_depth = 0;
+    int32_t sampling = 0;
+    uint32_t aovs = 0; // aovs in the image state
+    int32_t track_luminance = 0;
+    int32_t samples_done = 0; // samples per pixel of an evenly sampled image, the mean of an adaptive one
+    int32_t strata = 0;       // samples per pixel the stratified sampler spreads its strata over, 0 for the others
+    int32_t unused = 0;       // keeps seed aligned without padding
+    uint64_t seed = 0;
+    int64_t samples_taken = 0; // samples of all pixels together
+    double camera[12] = {};    // lookfrom, lookat, vup, vfov, defocus angle and focus distance
+    uint64_t state_size = 0;   // bytes of image state after the header
+
+    // whether a render with these settings can continue the one of other
+    bool same_render(const checkpoint_header &other) const
+    {
+        for (int i = 0; i < 8; i++)
+            if (magic[i] != other.magic[i])
+                return false;
+        for (int i = 0; i < 12; i++)
+            if (camera[i] != other.camera[i])
+                return false;
+        return width == other.width && height == other.height && precision == other.precision &&
+               max_depth == other.max_depth && russian_roulette == other.russian_roulette &&
+               roulette_min_depth == other.roulette_min_depth && sampling == other.sampling && aovs == other.aovs &&
+               track_luminance == other.track_luminance && strata == other.strata && seed == other.seed;
+    }
+};
+
+static_assert(sizeof(checkpoint_header) == 176, "checkpoint_header must not contain padding");
+
+// Writes checkpoints on a thread of its own, so the workers go on rendering while the file is written. The file is
+// replaced in one step (written next to it and renamed), so a crash while writing keeps the previous checkpoint.
+class checkpoint_writer
+{
+public:
+    ~checkpoint_writer()
+    {
+        wait();
+    }
+
+    // buffer for the image state of the next checkpoint, waits until the previous one is written
+    std::vector<uint8_t> &state()
+    {
+        wait();
+        return buffer;
+    }
+
+    // starts writing the header and the state buffer to filename
+    void write(const std::string &filename, const checkpoint_header &header)
+    {
+        wait();
+        pending = header;
+        pending.state_size = buffer.size();
+        writer = std::thread([this, filename]
+                             { write_file(filename); });
+    }
+
+    void wait()
+    {
+        if (writer.joinable())
+            writer.join();
+    }
+
+private:
+    std::thread writer;
+    std::vector<uint8_t> buffer;
+    checkpoint_header pending;
+
+    void write_file(const std::string &filename) const
+    {
+        std::string temporary = filename + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary);
+            out.write(reinterpret_cast<const char *>(&pending), sizeof(pending));
+            out.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+            if (!out)
+            {
+                std::cerr << "Could not write checkpoint " << temporary << "\n";
+                return;
+            }
+        }
+        if (std::rename(temporary.c_str(), filename.c_str()) != 0)
+            std::cerr << "Could not replace checkpoint " << filename << "\n";
+    }
+};
+
+enum class checkpoint_status
+{
+    missing,  // there is no checkpoint file
+    mismatch, // the file is damaged or belongs to a render with other settings
+    loaded
+};
+
+// Reads the checkpoint of the render expected describes, whose image state takes state_size bytes. The header has to
+// match before anything is allocated, so a damaged or foreign file is rejected instead of sizing the buffer.
+inline checkpoint_status read_checkpoint(const std::string &filename, const checkpoint_header &expected, size_t state_size,
+                                         checkpoint_header &header, std::vector<uint8_t> &state)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        return checkpoint_status::missing;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) || !header.same_render(expected) ||
+        header.state_size != state_size)
+        return checkpoint_status::mismatch;
+    state.resize(state_size);
+    if (!in.read(reinterpret_cast<char *>(state.data()), state.size()))
+        return checkpoint_status::mismatch;
+    return checkpoint_status::loaded;
+}
+
+#endif
@@ -0,0 +1,272 @@
+#include "cpu_render.hh"
+
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static render_progress progress;
+
+// first Ctrl+C finishes the current pass of a progressive or adaptive render, a second one terminates right away
+static void handle_interrupt(int)
+{
+    progress.request_stop();
+    std::signal(SIGINT, SIG_DFL);
+}
+
+static void print_usage(const char *name)
+{
+    std::cout << "Usage: " << name << " [options]\n"
+              << "Renders the final scene on the CPU without a window.\n\n"
+              << "  -o, --output <file>      image file to write (default: out.ppm)\n"
+              << "                           .ppm, .pfm (float), .qoi or .png, chosen by the extension\n"
+              << "      --height <px>        image height in pixels (default: 1080)\n"
+              << "      --aspect <w:h|r>     aspect ratio, e.g. 16:9 or 1.5 (default: 16:9)\n"
+              << "  -s, --spp <n>            samples per pixel (default: 10)\n"
+              << "  -d, --depth <n>          maximum ray bounces (default: 10)\n"
+              << "      --float              trace in single precision (faster, half the memory)\n"
+              << "      --roulette           end dim paths early with russian roulette (unbiased)\n"
+              << "      --roulette-depth <n> bounces before russian roulette starts (default: 3)\n"
+              << "      --from <x,y,z>       camera position (default: 13,2,3)\n"
+              << "      --at <x,y,z>         focal point (default: 0,0,0)\n"
+              << "      --fov <deg>          vertical field of view (default: 20)\n"
+              << "      --defocus <deg>      defocus angle (default: 0.6)\n"
+              << "  -t, --threads <n>        render threads (default: all cores)\n"
+              << "      --seed <n>           seed for the sampling random numbers (default: 0)\n"
+              << "      --sampler <s>        independent, stratified, sobol or owen (default: owen)\n"
+              << "      --schedule <s>       lines or tiles (default: lines)\n"
+              << "      --tile-size <px>     tile edge length, widths round up to 16 (default: 32)\n"
+              << "      --tile-order <o>     morton or spiral (default: morton)\n"
+              << "      --progressive        render one sample per pixel per pass, Ctrl+C stops after the current pass\n"
+              << "                           and still writes the image\n"
+              << "      --adaptive           spend more samples on noisy pixels, --spp becomes the mean per pixel\n"
+              << "      --min-spp <n>        samples of every pixel before it may count as converged (default: 8)\n"
+              << "      --noise-threshold <e> relative luminance error at which a pixel is converged (default: 0.02)\n"
+              << "      --sample-map <file>  write the samples taken per pixel as pgm (adaptive only)\n"
+              << "      --denoise            filter the image, guided by the albedo, normal and depth of the first hits\n"
+              << "      --aov <list>         also write depth, normal, albedo, id and/or rays (comma separated, or all),\n"
+              << "                           each next to the image: out.png gets out.depth.png and so on\n"
+              << "      --checkpoint <file>  save the render state to file between passes, Ctrl+C stops after the current\n"
+              << "                           pass, saves and still writes the image\n"
+              << "      --checkpoint-interval <s> seconds between checkpoints (default: 60)\n"
+              << "      --resume             continue from the --checkpoint file if it exists, --spp may be raised\n"
+              << "                           unless the sampler is stratified\n"
+              << "      --isa <level>        kernels to render with: baseline, sse4.2, avx2, avx512 or best (default: best,\n"
+              << "                           or the RAYTRACER_ISA environment variable)\n"
+              << "      --help               show this message\n";
+}
+
+static bool parse_int(const char *text, int &value)
+{
+    char *end;
+    errno = 0;
+    long v = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX)
+        return false;
+    value = static_cast<int>(v);
+    return true;
+}
+
+static bool parse_double(const char *text, double &value)
+{
+    char *end;
+    double v = std::strtod(text, &end);
+    if (end == text || *end != '\0' || !std::isfinite(v)) // strtod also reads inf and nan
+        return false;
+    value = v;
+    return true;
+}
+
+static bool parse_uint64(const char *text, uint64_t &value)
+{
+    char *end;
+    errno = 0;
+    unsigned long long v = std::strtoull(text, &end, 10);
+    if (end == text || *end != '\0' || *text == '-' || errno == ERANGE)
+        return false;
+    value = v;
+    return true;
+}
+
+// accepts "16:9", "16/9" or a plain ratio like "1.777"
+static bool parse_aspect(const char *text, double &value)
+{
+    double w, h;
+    char sep;
+    if (std::sscanf(text, "%lf%c%lf", &w, &sep, &h) == 3 && (sep == ':' || sep == '/') && h > 0)
+    {
+        value = w / h;
+        return std::isfinite(value);
+    }
+    return parse_double(text, value);
+}
+
+static bool parse_point(const char *text, point &value)
+{
+    char tail;
+    return std::sscanf(text, "%f,%f,%f%c", &value.x, &value.y, &value.z, &tail) == 3 && std::isfinite(value.x) &&
+           std::isfinite(value.y) && std::isfinite(value.z);
+}
+
+static bool parse_sampler(const char *text, sampler_kind &value)
+{
+    const char *names[] = {"independent", "stratified", "sobol", "owen"};
+    const sampler_kind kinds[] = {sampler_kind::independent, sampler_kind::stratified, sampler_kind::sobol, sampler_kind::owen};
+    for (int i = 0; i < 4; i++)
+    {
+        if (!std::strcmp(text, names[i]))
+        {
+            value = kinds[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    cpu_render_settings settings;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (!std::strcmp(arg, "--help"))
+        {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (!std::strcmp(arg, "--progressive"))
+        {
+            settings.progressive = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--float"))
+        {
+            settings.single_precision = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--roulette"))
+        {
+            settings.russian_roulette = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--adaptive"))
+        {
+            settings.adaptive = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--denoise"))
+        {
+            settings.denoise = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--resume"))
+        {
+            settings.resume = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Unknown option or missing value: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        const char *value = argv[++i];
+        bool ok;
+        if (!std::strcmp(arg, "-o") || !std::strcmp(arg, "--output"))
+        {
+            settings.output_file = value;
+            ok = !settings.output_file.empty();
+        }
+        else if (!std::strcmp(arg, "--height"))
+            ok = parse_int(value, settings.image_height) && settings.image_height > 0;
+        else if (!std::strcmp(arg, "--aspect"))
+            ok = parse_aspect(value, settings.aspect_ratio) && settings.aspect_ratio > 0;
+        else if (!std::strcmp(arg, "-s") || !std::strcmp(arg, "--spp"))
+            ok = parse_int(value, settings.samples_per_pixel) && settings.samples_per_pixel > 0;
+        else if (!std::strcmp(arg, "-d") || !std::strcmp(arg, "--depth"))
+            ok = parse_int(value, settings.max_depth) && settings.max_depth > 0;
+        else if (!std::strcmp(arg, "--roulette-depth"))
+            ok = parse_int(value, settings.roulette_min_depth) && settings.roulette_min_depth >= 0;
+        else if (!std::strcmp(arg, "--from"))
+            ok = parse_point(value, settings.cam_pos);
+        else if (!std::strcmp(arg, "--at"))
+            ok = parse_point(value, settings.focal_point);
+        else if (!std::strcmp(arg, "--fov"))
+            ok = parse_double(value, settings.vfov) && settings.vfov > 0 && settings.vfov < 180;
+        else if (!std::strcmp(arg, "--defocus"))
+            ok = parse_double(value, settings.defocus_angle) && settings.defocus_angle >= 0;
+        else if (!std::strcmp(arg, "-t") || !std::strcmp(arg, "--threads"))
+            ok = parse_int(value, settings.cpu_count) && settings.cpu_count > 0;
+        else if (!std::strcmp(arg, "--seed"))
+            ok = parse_uint64(value, settings.seed);
+        else if (!std::strcmp(arg, "--sampler"))
+            ok = parse_sampler(value, settings.sampling);
+        else if (!std::strcmp(arg, "--schedule"))
+        {
+            ok = !std::strcmp(value, "lines") || !std::strcmp(value, "tiles");
+            settings.schedule = !std::strcmp(value, "lines") ? schedule_mode::lines : schedule_mode::tiles;
+        }
+        else if (!std::strcmp(arg, "--tile-size"))
+            ok = parse_int(value, settings.tile_size) && settings.tile_size > 0;
+        else if (!std::strcmp(arg, "--tile-order"))
+        {
+            ok = !std::strcmp(value, "morton") || !std::strcmp(value, "spiral");
+            settings.tile_ordering = !std::strcmp(value, "spiral") ? tile_order::spiral : tile_order::morton;
+        }
+        else if (!std::strcmp(arg, "--min-spp"))
+            ok = parse_int(value, settings.adaptive_min_samples) && settings.adaptive_min_samples > 1;
+        else if (!std::strcmp(arg, "--noise-threshold"))
+            ok = parse_double(value, settings.adaptive_threshold) && settings.adaptive_threshold > 0;
+        else if (!std::strcmp(arg, "--aov"))
+            ok = parse_aovs(value, settings.aovs);
+        else if (!std::strcmp(arg, "--checkpoint"))
+        {
+            settings.checkpoint_file = value;
+            ok = !settings.checkpoint_file.empty();
+        }
+        else if (!std::strcmp(arg, "--checkpoint-interval"))
+            ok = parse_double(value, settings.checkpoint_interval) && settings.checkpoint_interval >= 0;
+        else if (!std::strcmp(arg, "--isa"))
+            ok = parse_isa(value, settings.isa);
+        else if (!std::strcmp(arg, "--sample-map"))
+        {
+            settings.sample_map_file = value;
+            ok = !settings.sample_map_file.empty();
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        if (!ok)
+        {
+            std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+            return 1;
+        }
+    }
+
+    if (settings.cpu_count <= 0)
+        settings.cpu_count = 1; // hardware_concurrency() may report 0
+
+    if (settings.resume && settings.checkpoint_file.empty())
+    {
+        std::cerr << "--resume needs a --checkpoint file\n";
+        return 1;
+    }
+
+    settings.progress = &progress;
+    if (settings.progressive || settings.adaptive || !settings.checkpoint_file.empty())
+        std::signal(SIGINT, handle_interrupt);
+
+    double render_time = 0.0;
+    return cpu_render(settings, render_time) ? 0 : 1;
+}
@@ -3,7 +3,10 @@
 
 #include "vec3.hh"
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
+#include <string>
 #include <vector>
 
 using color = vec3;
@@ -13,41 +16,55 @@ inline double linear_to_gamma(double linear_component)
     return sqrt(linear_component);
 }
 
-void write_color(color *image, int image_width, int image_height, int samples_per_pixel)
+// perceived brightness of a linear color (Rec. 709 weights)
+template <typename T>
+inline T luminance(const basic_vec3<T> &c)
 {
-    std::ofstream out("out.ppm");
-    // write ppm header
-    out.write("P3\n", 3);
-    out.write(std::to_string(image_width).c_str(), std::to_string(image_width).length());
-    out.write(" ", 1);
-    out.write(std::to_string(image_height).c_str(), std::to_string(image_height).length());
-    out.write("\n", 1);
-    out.write("255\n", 4);
+    return T(0.2126) * c.x() + T(0.7152) * c.y() + T(0.0722) * c.z();
+}
+
+// maps a linear color component to the gamma corrected [0,255] range
+inline uint8_t component_to_byte(double linear_component)
+{
+    static const interval intensity(0.000, 0.999);
+    return static_cast<uint8_t>(256 * intensity.clamp(linear_to_gamma(linear_component)));
+}
 
+// writes the number of samples of every pixel as binary pgm, brighter pixels took more samples
+inline bool write_sample_map(const std::string &filename, const uint32_t *counts, int image_width, int image_height)
+{
+    std::ofstream out(filename, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Could not open " << filename << " for writing\n";
+        return false;
+    }
+    uint32_t max_count = 1;
+    for (int i = 0; i < image_width * image_height; i++)
+        max_count = std::max(max_count, counts[i]);
+    max_count = std::min<uint32_t>(max_count, 65535);
+    out << "P5\n" << image_width << " " << image_height << "\n" << max_count << "\n";
+
+    // pgm stores values above 255 as 16 bit big endian
+    int bytes = max_count > 255 ? 2 : 1;
+    std::vector<uint8_t> data(static_cast<size_t>(bytes) * image_width * image_height);
     for (int i = 0; i < image_width * image_height; i++)
     {
-        color pixel_color = image[i];
-        auto r = pixel_color.x();
-        auto g = pixel_color.y();
-        auto b = pixel_color.z();
-
-        // Divide the color by the number of samples.
-        auto scale = 1.0 / samples_per_pixel;
-        r *= scale;
-        g *= scale;
-        b *= scale;
-
-        // transform to gamma values
-        r = linear_to_gamma(r);
-        g = linear_to_gamma(g);
-        b = linear_to_gamma(b);
-
-        // Write the translated [0,255] value of each color component.
-        static const interval intensity(0.000, 0.999);
-        out << static_cast<int>(256 * intensity.clamp(r)) << ' '
-            << static_cast<int>(256 * intensity.clamp(g)) << ' '
-            << static_cast<int>(256 * intensity.clamp(b)) << '\n';
+        uint32_t count = std::min(counts[i], max_count);
+        if (bytes == 2)
+        {
+            data[2 * i] = static_cast<uint8_t>(count >> 8);
+            data[2 * i + 1] = static_cast<uint8_t>(count);
+        }
+        else
+            data[i] = static_cast<uint8_t>(count);
+    }
+    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    if (!out)
+    {
+        std::cerr << "Could not write " << filename << "\n";
+        return false;
     }
-    out.close();
+    return true;
 }
-#endif
\ No newline at end of file
+#endif
@@ -1,82 +1,137 @@
 #include "cpu_render.hh"
-#include "rtweekend.hh"
+#include "render_kernels.hh"
 
-#include "camera.hh"
-#include "color.hh"
-#include "hittable_list.hh"
-#include "sphere.hh"
-#include "material.hh"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 
-void cpu_render(int _image_height, double _aspect_ratio, int _samples_per_pixel, int _max_depth,
-                point t_cam_pos, point t_focal_point, double _vfov, double _defocus_angle, int cpu_count, double &last_render_time)
+// render workers are kept alive between renders and only restarted when the thread count changes
+static thread_pool render_pool;
+
+using render_kernel = bool (*)(const cpu_render_settings &, thread_pool &, double &);
+
+isa_level detect_isa()
 {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // checks cpuid and whether the os saves the wider registers
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi2");
+    if (avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+        __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq"))
+        return isa_level::avx512;
+    if (avx2)
+        return isa_level::avx2;
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+        return isa_level::sse42;
+#endif
+    return isa_level::baseline;
+}
 
-    point3 _cam_pos(t_cam_pos.x, t_cam_pos.y, t_cam_pos.z);
-    point3 _focal_point(t_focal_point.x, t_focal_point.y, t_focal_point.z);
+const char *isa_name(isa_level level)
+{
+    switch (level)
+    {
+    case isa_level::sse42:
+        return "sse4.2";
+    case isa_level::avx2:
+        return "avx2";
+    case isa_level::avx512:
+        return "avx512";
+    case isa_level::best:
+        return "best";
+    default:
+        return "baseline";
+    }
+}
 
-    camera cam;
-    cam.aspect_ratio = _aspect_ratio;
-    cam.image_height = _image_height;
-    cam.samples_per_pixel = _samples_per_pixel;
-    cam.max_depth = _max_depth;
-    cam.vfov = _vfov;
-    cam.lookfrom = _cam_pos;
-    cam.lookat = _focal_point;
-    cam.defocus_angle = _defocus_angle;
-    cam.processor_count = cpu_count;
+bool parse_isa(const char *text, isa_level &level)
+{
+    for (isa_level candidate : {isa_level::baseline, isa_level::sse42, isa_level::avx2, isa_level::avx512, isa_level::best})
+    {
+        if (!std::strcmp(text, isa_name(candidate)))
+        {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
 
-    cam.vup = vec3(0, 1, 0);
-    cam.focus_dist = (_cam_pos - _focal_point).length();
+// what the log calls the kernels of a level, the baseline copy of a native build runs the instructions of this machine
+static const char *kernel_name(isa_level level)
+{
+#if defined(RAYTRACER_NATIVE)
+    if (level == isa_level::baseline)
+        return "native";
+#endif
+    return isa_name(level);
+}
 
-    hittable_list world;
+// the requested level, else the one RAYTRACER_ISA names, else the highest one, but never one the cpu can't run
+static isa_level select_isa(isa_level requested)
+{
+    static const isa_level detected = detect_isa();
+#if defined(RAYTRACER_ISA_DISPATCH)
+    isa_level available = detected;
+#else
+    isa_level available = isa_level::baseline;
+#endif
 
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+    const char *env = std::getenv("RAYTRACER_ISA");
+    if (requested == isa_level::best && env && !parse_isa(env, requested))
+        std::clog << "Ignoring unknown RAYTRACER_ISA=" << env << ".\n";
 
-    for (int a = -11; a < 11; a++)
+    if (requested == isa_level::best)
+        return available;
+    if (requested > available)
     {
-        for (int b = -11; b < 11; b++)
-        {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-
-            if ((center - point3(4, 0.2, 0)).length() > 0.9)
-            {
-                shared_ptr<material> sphere_material;
+        std::clog << isa_name(requested) << " kernels are not available (cpu supports " << isa_name(detected)
+                  << "), falling back to " << kernel_name(available) << ".\n";
+        return available;
+    }
+    return requested;
+}
 
-                if (choose_mat < 0.8)
-                {
-                    // diffuse
-                    auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-                else if (choose_mat < 0.95)
-                {
-                    // metal
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-                else
-                {
-                    // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-            }
-        }
+static render_kernel kernel_for(isa_level level)
+{
+    switch (level)
+    {
+#if defined(RAYTRACER_ISA_DISPATCH)
+    case isa_level::sse42:
+        return render_kernels_sse42;
+    case isa_level::avx2:
+        return render_kernels_avx2;
+    case isa_level::avx512:
+        return render_kernels_avx512;
+#endif
+    default:
+        return render_kernels_baseline;
     }
+}
 
-    auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+bool cpu_render(const cpu_render_settings &settings, double &last_render_time)
+{
+    isa_level level = select_isa(settings.isa);
+    std::clog << "Using " << kernel_name(level) << " kernels.\n";
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+    render_pool.resize(std::max(1, settings.cpu_count)); // the default hardware_concurrency() may be 0
+    return kernel_for(level)(settings, render_pool, last_render_time);
+}
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+bool cpu_render(int _image_height, double _aspect_ratio, int _samples_per_pixel, int _max_depth,
+                point t_cam_pos, point t_focal_point, double _vfov, double _defocus_angle, int cpu_count, double &last_render_time)
+{
+    cpu_render_settings settings;
+    settings.image_height = _image_height;
+    settings.aspect_ratio = _aspect_ratio;
+    settings.samples_per_pixel = _samples_per_pixel;
+    settings.max_depth = _max_depth;
+    settings.cam_pos = t_cam_pos;
+    settings.focal_point = t_focal_point;
+    settings.vfov = _vfov;
+    settings.defocus_angle = _defocus_angle;
+    settings.cpu_count = cpu_count;
 
-    cam.render(world, last_render_time);
-}
\ No newline at end of file
+    return cpu_render(settings, last_render_time);
+}
@@ -2,7 +2,72 @@
 #define CPU_RENDER_HH
 
 #include "./point.hh"
+#include "aov.hh"
+#include "progress.hh"
+#include "sampler.hh"
+#include "scheduler.hh"
 
-void cpu_render(int _image_height, double _aspect_ratio, int _samples_per_pixel, int _max_depth, point t_cam_pos, point t_focal_point, double _vfov, double _defocus_angle, int cpu_count, double &last_render_time);
+#include <cstdint>
+#include <string>
+#include <thread>
 
-#endif
\ No newline at end of file
+// instruction set levels the render kernels are compiled for (see render_kernels.hh)
+enum class isa_level
+{
+    baseline, // what the compiler targets without flags, sse2 on x86-64
+    sse42,    // sse4.2 and popcnt
+    avx2,     // avx2, fma and bmi2
+    avx512,   // avx-512 f, vl, bw and dq on top of avx2
+    best      // the highest level the cpu supports
+};
+
+// all camera and quality parameters of a cpu render, defaults match the GUI
+struct cpu_render_settings
+{
+    int image_height = 1080;
+    double aspect_ratio = 16.0 / 9.0;
+    int samples_per_pixel = 10;
+    int max_depth = 10;
+    bool single_precision = false; // trace in float instead of double: twice the simd width, half the scene and image memory
+    bool russian_roulette = false; // end dim paths early at random, keeps the image unbiased and makes deep renders cheap
+    int roulette_min_depth = 3;    // bounces before russian roulette may end a path
+    point cam_pos = {13, 2, 3};
+    point focal_point = {0, 0, 0};
+    double vfov = 20;
+    double defocus_angle = 0.6;
+    int cpu_count = std::thread::hardware_concurrency();
+    uint64_t seed = 0;                   // seed of the sampling random numbers, renders with the same seed are identical for any thread count and tile order
+    sampler_kind sampling = sampler_kind::owen; // how the samples of a pixel are spread, owen has the least noise per sample
+    std::string output_file = "out.ppm"; // where the rendered image is written to, the extension picks the format (see image_writer.hh), empty writes no file
+    render_progress *progress = nullptr;  // optional, polled by the caller while the render runs
+    schedule_mode schedule = schedule_mode::lines; // tiles is opt-in until multi-core timings show it is faster
+    int tile_size = 32;
+    tile_order tile_ordering = tile_order::morton;
+    bool progressive = false;             // one sample per pixel per pass, can be stopped after any pass through progress
+    render_snapshot *snapshot = nullptr;  // optional, receives the finished image (and every progressive pass) in memory
+    bool adaptive = false;                // spend the samples on noisy pixels, samples_per_pixel becomes the mean
+    int adaptive_min_samples = 8;         // samples of every pixel before it may count as converged
+    double adaptive_threshold = 0.02;     // relative standard error of the luminance at which a pixel counts as converged
+    std::string sample_map_file;          // optional, pgm with the samples taken per pixel of an adaptive render
+    bool denoise = false;                 // filter the image guided by the albedo, normal and depth of the first hits (see denoiser.hh)
+    aov_set aovs = 0;                     // extra channels rendered in the same pass, each written next to output_file (see aov.hh)
+    std::string checkpoint_file;          // optional, the render state is saved there every checkpoint_interval seconds (see checkpoint.hh)
+    double checkpoint_interval = 60;
+    bool resume = false;                  // continue from checkpoint_file if it exists, with the same settings and at least as many samples
+    isa_level isa = isa_level::best;      // kernels to render with, best also reads RAYTRACER_ISA, levels the cpu lacks fall back
+};
+
+// highest instruction set level of this cpu, checked with cpuid
+isa_level detect_isa();
+
+const char *isa_name(isa_level level);
+
+// accepts the names isa_name returns: baseline, sse4.2, avx2, avx512 or best
+bool parse_isa(const char *text, isa_level &level);
+
+// false if the render failed: it could not resume from its checkpoint or could not write its files
+bool cpu_render(const cpu_render_settings &settings, double &last_render_time);
+
+bool cpu_render(int _image_height, double _aspect_ratio, int _samples_per_pixel, int _max_depth, point t_cam_pos, point t_focal_point, double _vfov, double _defocus_angle, int cpu_count, double &last_render_time);
+
+#endif
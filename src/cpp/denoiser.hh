@@ -0,0 +1,343 @@
+#ifndef DENOISER_HH
+#define DENOISER_HH
+
+#include "thread_pool.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// a rendered image and what the camera rays hit first, one plane per channel, line by line without gaps
+struct denoise_frame
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> color[3];  // mean of the samples, holds the denoised image after denoise()
+    std::vector<float> albedo[3]; // mean color of the first surface hit, the sky color for rays that hit nothing
+    std::vector<float> normal[3]; // mean normal of the first surface hit (facing the ray), 0 for rays that hit nothing
+    std::vector<float> depth;     // mean distance to the first surface hit, 0 for rays that hit nothing
+    std::vector<float> variance;  // variance of the mean luminance, negative for pixels with too few samples to tell
+
+    void resize(int _width, int _height)
+    {
+        width = _width;
+        height = _height;
+        size_t count = static_cast<size_t>(width) * height;
+        for (int c = 0; c < 3; c++)
+        {
+            color[c].resize(count);
+            albedo[c].resize(count);
+            normal[c].resize(count);
+        }
+        depth.resize(count);
+        variance.resize(count);
+    }
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the variance guided luminance weight of SVGF
+// (Schied et al. 2017), without its temporal part. Every iteration blurs with a 5x5 B3 spline whose taps lie 2^i pixels
+// apart, so four iterations reach 30 pixels in every direction with 25 taps each. A tap counts less the more its normal,
+// depth and luminance differ from the center, luminance differences are measured in standard deviations of the noise.
+// The light arriving at the surfaces is filtered instead of the color: dividing out the albedo first keeps the edges
+// between differently colored objects sharp. Every pass is split between the workers of the pool line by line.
+class atrous_denoiser
+{
+public:
+    int iterations = 4; // a fifth one doesn't lower the error of the final scene, even at 720p
+    float luminance_sigma = 4; // luminance differences of this many standard deviations of the noise count as an edge
+    float depth_sigma = 1;     // depth differences of this many times the local depth slope count as an edge
+
+    void denoise(denoise_frame &frame, thread_pool *pool)
+    {
+        width = frame.width;
+        height = frame.height;
+        size_t count = static_cast<size_t>(width) * height;
+        for (int c = 0; c < 3; c++)
+        {
+            light[c].resize(count);
+            light_next[c].resize(count);
+            normal[c].resize(count);
+        }
+        lum.resize(count);
+        lum_next.resize(count);
+        var.resize(count);
+        var_next.resize(count);
+        luminance_scale.resize(count);
+        slope_x.resize(count);
+        slope_y.resize(count);
+        size_t rows = static_cast<size_t>(width) * line_workers(pool);
+        for (int c = 0; c < 3; c++)
+            row_sum[c].resize(rows);
+        row_weights.resize(rows);
+        row_variance.resize(rows);
+
+        for_each_line(height, pool, [&](int j)
+                      { prepare_line(frame, j); });
+        for_each_line(height, pool, [&](int j)
+                      { estimate_line(frame, j); });
+
+        for (int i = 0; i < iterations; i++)
+        {
+            for_each_line(height, pool, [&](int j)
+                          { blur_variance_line(j); });
+            for_each_line_of_worker(height, pool, [&](int j, int worker)
+                                    { filter_line(frame, j, 1 << i, worker); });
+            for (int c = 0; c < 3; c++)
+                light[c].swap(light_next[c]);
+            lum.swap(lum_next);
+            var.swap(var_next);
+        }
+
+        for_each_line(height, pool, [&](int j)
+                      {
+            for (size_t p = index(0, j); p < index(width, j); p++)
+                for (int c = 0; c < 3; c++)
+                    frame.color[c][p] = (frame.albedo[c][p] + albedo_epsilon) * light[c][p]; });
+    }
+
+private:
+    static constexpr float albedo_epsilon = 1e-3f; // keeps the division by the albedo finite for black surfaces
+    static constexpr float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+    // scratch planes, kept between calls so a progressive render doesn't allocate them for every pass
+    int width = 0;
+    int height = 0;
+    std::vector<float> light[3], light_next[3]; // color divided by the albedo
+    std::vector<float> normal[3];               // unit normals
+    std::vector<float> lum, lum_next;           // luminance of the color
+    std::vector<float> var, var_next;
+    std::vector<float> luminance_scale; // 1 / (luminance_sigma * standard deviation of the noise)
+    std::vector<float> slope_x, slope_y; // change of the depth to the next pixel
+    std::vector<float> row_sum[3], row_weights, row_variance; // one line per worker for filter_line
+
+    size_t index(int x, int y) const
+    {
+        return static_cast<size_t>(y) * width + x;
+    }
+
+    static float luminance_of(float r, float g, float b)
+    {
+        return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    }
+
+    void prepare_line(const denoise_frame &frame, int j)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            size_t p = index(i, j);
+            for (int c = 0; c < 3; c++)
+                light[c][p] = frame.color[c][p] / (frame.albedo[c][p] + albedo_epsilon);
+            lum[p] = luminance_of(frame.color[0][p], frame.color[1][p], frame.color[2][p]);
+
+            float nx = frame.normal[0][p], ny = frame.normal[1][p], nz = frame.normal[2][p];
+            float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+            float scale = length > 0 ? 1 / length : 0;
+            normal[0][p] = nx * scale;
+            normal[1][p] = ny * scale;
+            normal[2][p] = nz * scale;
+        }
+    }
+
+    // Pixels with a single sample have no variance of their own, they take the variance of the luminance around them
+    // instead. The depth slope is the smaller of the differences to both neighbours, so it stays small at edges.
+    void estimate_line(const denoise_frame &frame, int j)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            size_t p = index(i, j);
+            var[p] = frame.variance[p];
+            if (var[p] < 0)
+            {
+                float sum = 0, squared = 0;
+                int n = 0;
+                for (int y = std::max(0, j - 1); y <= std::min(height - 1, j + 1); y++)
+                    for (int x = std::max(0, i - 1); x <= std::min(width - 1, i + 1); x++)
+                    {
+                        float l = lum[index(x, y)];
+                        sum += l;
+                        squared += l * l;
+                        n++;
+                    }
+                float mean = sum / n;
+                var[p] = std::max(0.0f, squared / n - mean * mean);
+            }
+
+            float z = frame.depth[p];
+            slope_x[p] = smaller_change(z, i > 0 ? &frame.depth[p - 1] : nullptr, i + 1 < width ? &frame.depth[p + 1] : nullptr);
+            slope_y[p] = smaller_change(z, j > 0 ? &frame.depth[p - width] : nullptr, j + 1 < height ? &frame.depth[p + width] : nullptr);
+        }
+    }
+
+    // smaller difference of z to the neighbours that exist, 0 without any
+    static float smaller_change(float z, const float *before, const float *after)
+    {
+        if (before && after)
+            return std::min(std::fabs(z - *before), std::fabs(*after - z));
+        if (before || after)
+            return std::fabs(z - *(before ? before : after));
+        return 0;
+    }
+
+    // The luminance weight divides by the standard deviation of the noise, taken from the variance blurred with a 3x3
+    // gaussian because the estimate of a single pixel is too noisy
+    void blur_variance_line(int j)
+    {
+        static constexpr float gauss[2] = {0.5f, 0.25f};
+        for (int i = 0; i < width; i++)
+        {
+            float sum = 0, weights = 0;
+            for (int y = std::max(0, j - 1); y <= std::min(height - 1, j + 1); y++)
+                for (int x = std::max(0, i - 1); x <= std::min(width - 1, i + 1); x++)
+                {
+                    float w = gauss[std::abs(x - i)] * gauss[std::abs(y - j)];
+                    sum += w * var[index(x, y)];
+                    weights += w;
+                }
+            luminance_scale[index(i, j)] = 1 / (luminance_sigma * std::sqrt(sum / weights) + 1e-4f);
+        }
+    }
+
+    // the normal weight, dot(n_p, n_q)^128 falls to a half at about 6 degrees
+    static float power_128(float x)
+    {
+        x *= x;
+        x *= x;
+        x *= x;
+        x *= x;
+        x *= x;
+        x *= x;
+        return x * x;
+    }
+
+    // e^x for x <= 0 to about 3e-4, unlike std::exp the compiler can vectorize it. x is clamped to -80 on its bits:
+    // the bits of a more negative float are a larger unsigned number, and unlike a float comparison (which might trap)
+    // an integer one doesn't keep the loop from being vectorized.
+    static float exp_negative(float x)
+    {
+        uint32_t x_bits;
+        std::memcpy(&x_bits, &x, sizeof(x));
+        x_bits = x_bits < 0xc2a00000u ? x_bits : 0xc2a00000u; // -80.0f
+        std::memcpy(&x, &x_bits, sizeof(x));
+
+        float y = x * 1.44269504f; // e^x = 2^y
+        int n = static_cast<int>(y); // rounds towards zero, so f is in (-1, 0]
+        float f = y - n;
+        float fraction = 1 + f * (0.6931472f + f * (0.2402265f + f * (0.0555041f + f * (0.0096181f + f * 0.0013333f))));
+        int32_t bits = (n + 127) << 23;
+        float power;
+        std::memcpy(&power, &bits, sizeof(power));
+        return fraction * power;
+    }
+
+    // a run of center pixels of a line and the pixels one tap of them lands on
+    struct tap_rows
+    {
+        const float *z, *z_tap;
+        const float *n[3], *n_tap[3];
+        const float *lum, *lum_tap, *scale;
+        const float *slope_x, *slope_y;
+        const float *light_tap[3], *var_tap;
+    };
+
+    // adds one tap to the sums of count pixels of a line. The sums are scratch of the line, restrict tells
+    // the compiler they don't overlap the rows, so it vectorizes the loop without checking.
+    static void add_tap(const tap_rows &rows, int count, float h, float depth_x, float depth_y,
+                        float *__restrict r, float *__restrict g, float *__restrict b, float *__restrict weights,
+                        float *__restrict variance)
+    {
+        const float *z = rows.z, *z_tap = rows.z_tap;
+        const float *nx = rows.n[0], *ny = rows.n[1], *nz = rows.n[2];
+        const float *nx_tap = rows.n_tap[0], *ny_tap = rows.n_tap[1], *nz_tap = rows.n_tap[2];
+        const float *l = rows.lum, *l_tap = rows.lum_tap, *scale = rows.scale;
+        const float *r_tap = rows.light_tap[0], *g_tap = rows.light_tap[1], *b_tap = rows.light_tap[2];
+        for (int i = 0; i < count; i++)
+        {
+            float cosine = nx[i] * nx_tap[i] + ny[i] * ny_tap[i] + nz[i] * nz_tap[i];
+            float w_normal = power_128(0.5f * (cosine + std::fabs(cosine))); // 0 for normals facing apart
+
+            float expected_depth_change = depth_x * rows.slope_x[i] + depth_y * rows.slope_y[i] + 1e-3f * z[i] + 1e-6f;
+            float depth_term = std::fabs(z[i] - z_tap[i]) / expected_depth_change;
+            float luminance_term = std::fabs(l[i] - l_tap[i]) * scale[i];
+
+            float w = h * w_normal * exp_negative(-depth_term - luminance_term);
+            weights[i] += w;
+            r[i] += w * r_tap[i];
+            g[i] += w * g_tap[i];
+            b[i] += w * b_tap[i];
+            variance[i] += w * w * rows.var_tap[i];
+        }
+    }
+
+    // One iteration for one line. The taps are the outer loop, so the inner loop walks along the lines without branches
+    // and the compiler vectorizes it.
+    void filter_line(const denoise_frame &frame, int j, int step, int worker)
+    {
+        size_t row = static_cast<size_t>(width) * worker;
+        float *sum[3] = {&row_sum[0][row], &row_sum[1][row], &row_sum[2][row]};
+        float *weights = &row_weights[row], *variance = &row_variance[row];
+        size_t line = index(0, j);
+        float center_weight = kernel[2] * kernel[2]; // the center tap always counts fully
+        for (int c = 0; c < 3; c++)
+        {
+            for (int i = 0; i < width; i++)
+                sum[c][i] = center_weight * light[c][line + i];
+        }
+        for (int i = 0; i < width; i++)
+        {
+            weights[i] = center_weight;
+            variance[i] = center_weight * center_weight * var[line + i];
+        }
+
+        for (int dy = -2; dy <= 2; dy++)
+        {
+            int y = j + dy * step;
+            if (y < 0 || y >= height)
+                continue;
+            for (int dx = -2; dx <= 2; dx++)
+            {
+                if (dx == 0 && dy == 0)
+                    continue;
+                int offset = dx * step;
+                int first = std::max(0, -offset), last = std::min(width, width - offset); // taps inside the image
+                size_t center = index(first, j), tap = index(first + offset, y);
+                float h = kernel[dx + 2] * kernel[dy + 2];
+                float depth_x = depth_sigma * step * std::abs(dx), depth_y = depth_sigma * step * std::abs(dy);
+
+                tap_rows rows;
+                rows.z = &frame.depth[center];
+                rows.z_tap = &frame.depth[tap];
+                for (int c = 0; c < 3; c++)
+                {
+                    rows.n[c] = &normal[c][center];
+                    rows.n_tap[c] = &normal[c][tap];
+                    rows.light_tap[c] = &light[c][tap];
+                }
+                rows.lum = &lum[center];
+                rows.lum_tap = &lum[tap];
+                rows.scale = &luminance_scale[center];
+                rows.slope_x = &slope_x[center];
+                rows.slope_y = &slope_y[center];
+                rows.var_tap = &var[tap];
+                add_tap(rows, last - first, h, depth_x, depth_y, &sum[0][first], &sum[1][first], &sum[2][first],
+                        &weights[first], &variance[first]);
+            }
+        }
+
+        for (int i = 0; i < width; i++)
+        {
+            size_t p = line + i;
+            float inverse = 1 / weights[i];
+            for (int c = 0; c < 3; c++)
+                light_next[c][p] = sum[c][i] * inverse;
+            var_next[p] = variance[i] * inverse * inverse;
+            lum_next[p] = luminance_of((frame.albedo[0][p] + albedo_epsilon) * light_next[0][p],
+                                       (frame.albedo[1][p] + albedo_epsilon) * light_next[1][p],
+                                       (frame.albedo[2][p] + albedo_epsilon) * light_next[2][p]);
+        }
+    }
+};
+
+#endif
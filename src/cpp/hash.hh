@@ -0,0 +1,17 @@
+#ifndef HASH_HH
+#define HASH_HH
+
+#include <cstdint>
+
+// 2^64 / golden ratio, odd, so adding it over and over visits every 64 bit value (a Weyl sequence)
+constexpr uint64_t golden_gamma = 0x9e3779b97f4a7c15ULL;
+
+// finalizer of SplitMix64: every input bit flips about half of the output bits, and no two inputs give the same output
+inline uint64_t mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+#endif
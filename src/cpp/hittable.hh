@@ -3,30 +3,50 @@
 
 #include "rtweekend.hh"
 
-class material;
+#include "aabb.hh"
 
-class hit_record
+template <typename T>
+class basic_material;
+
+template <typename T>
+class basic_hit_record
 {
 public:
-    point3 p;
-    vec3 normal;
-    shared_ptr<material> mat;
-    double t;
+    basic_point3<T> p;
+    basic_vec3<T> normal;
+    const basic_material<T> *mat; // non-owning, the material table of the scene keeps the material alive
+    T t;
     bool front_face;
+    T spawn_offset = 0; // bound for the rounding error of p along the normal, set by the object that was hit
+    int object_id = -1; // index of the object in the scene list, set by the list or the bvh it was found in
 
-    void set_face_normal(const ray &r, const vec3 &outward_normal)
+    void set_face_normal(const basic_ray<T> &r, const basic_vec3<T> &outward_normal)
     {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    // ray leaving the hit point. Its origin is moved off the surface by the error bound of p, to the side the ray
+    // leaves to, so it can't hit the surface it starts on again and needs no minimum distance.
+    basic_ray<T> spawn_ray(const basic_vec3<T> &direction) const
+    {
+        T offset = dot(direction, normal) > 0 ? spawn_offset : -spawn_offset;
+        return basic_ray<T>(p + offset * normal, direction);
+    }
 };
 
-class hittable
+template <typename T>
+class basic_hittable
 {
 public:
-    virtual ~hittable() = default;
+    virtual ~basic_hittable() = default;
+
+    virtual bool hit(const basic_ray<T> &r, basic_interval<T> ray_t, basic_hit_record<T> &rec) const = 0; // = 0 ~> every child class needs to implement this
 
-    virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0; // = 0 ~> every child class needs to implement this
+    virtual basic_aabb<T> bounding_box() const = 0; // box enclosing the whole object, used to build the bvh
 };
 
-#endif
\ No newline at end of file
+using hit_record = basic_hit_record<double>;
+using hittable = basic_hittable<double>;
+
+#endif
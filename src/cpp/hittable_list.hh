@@ -9,44 +9,64 @@
 using std::make_shared;
 using std::shared_ptr; // makes sure an object that is referenced multiple times gets safely deleted
 
-class hittable_list : public hittable
+template <typename T>
+class basic_hittable_list : public basic_hittable<T>
 {
 public:
-    std::vector<shared_ptr<hittable>> objects;
+    std::vector<shared_ptr<basic_hittable<T>>> objects;
+    std::vector<shared_ptr<basic_material<T>>> materials; // owns the materials that objects point to
 
-    hittable_list() {}
-    hittable_list(shared_ptr<hittable> object) { add(object); } // create list with an initial object
+    basic_hittable_list() {}
+    basic_hittable_list(shared_ptr<basic_hittable<T>> object) { add(object); } // create list with an initial object
 
     // clear the list
     void clear()
     {
         objects.clear();
+        materials.clear();
+        bbox = basic_aabb<T>();
     }
 
     // add an hittable object to the list of objects
-    void add(shared_ptr<hittable> object)
+    void add(shared_ptr<basic_hittable<T>> object)
     {
         objects.push_back(object);
+        bbox = basic_aabb<T>(bbox, object->bounding_box());
+    }
+
+    // add a material to the material table, the returned pointer stays valid as long as the list exists
+    const basic_material<T> *add_material(shared_ptr<basic_material<T>> mat)
+    {
+        materials.push_back(mat);
+        return mat.get();
     }
 
     // determine wheter ray hits and object from the hittable list and if so which one is the first it hits (since it then bounces off that)
-    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    bool hit(const basic_ray<T> &r, basic_interval<T> ray_t, basic_hit_record<T> &rec) const override
     {
-        hit_record temp_rec;
+        basic_hit_record<T> temp_rec;
         bool hit_anything = false;
         auto clostest_so_far = ray_t.max;
 
-        for (const auto &object : objects)
+        for (size_t i = 0; i < objects.size(); i++)
         { // for each object use the hit function of that object to see wheter its hit or not
-            if (object->hit(r, interval(ray_t.min, clostest_so_far), temp_rec))
+            if (objects[i]->hit(r, basic_interval<T>(ray_t.min, clostest_so_far), temp_rec))
             {
                 hit_anything = true;
                 clostest_so_far = temp_rec.t;
                 rec = temp_rec;
+                rec.object_id = static_cast<int>(i);
             }
         }
         return hit_anything;
     }
+
+    basic_aabb<T> bounding_box() const override { return bbox; }
+
+private:
+    basic_aabb<T> bbox;
 };
 
+using hittable_list = basic_hittable_list<double>;
+
 #endif
\ No newline at end of file
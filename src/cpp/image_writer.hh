@@ -0,0 +1,447 @@
+#ifndef IMAGE_WRITER_HH
+#define IMAGE_WRITER_HH
+
+#include "rtweekend.hh"
+
+#include "aov.hh"
+#include "color.hh"
+#include "hash.hh"
+#include "thread_pool.hh"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// writes a finished image to a file, every pixel holds the linear mean of its samples, top line first
+class image_writer
+{
+public:
+    virtual ~image_writer() = default;
+
+    // pool is optional, the pixel conversion is split between its workers
+    virtual bool write(std::ostream &out, const color *image, int width, int height, thread_pool *pool) const = 0;
+
+    // writes 1 (grey) or 3 channels that are stored as one plane of floats each, line by line without gaps
+    virtual bool write_channels(std::ostream &out, const float *const *planes, int channels, int width, int height,
+                                thread_pool *pool) const
+    {
+        std::vector<color> image(static_cast<size_t>(width) * height);
+        for_each_line(height, pool, [&](int j)
+                      {
+            for (size_t p = static_cast<size_t>(j) * width; p < static_cast<size_t>(j + 1) * width; p++)
+                image[p] = channels == 3 ? color(planes[0][p], planes[1][p], planes[2][p]) : color(planes[0][p], planes[0][p], planes[0][p]); });
+        return write(out, image.data(), width, height, pool);
+    }
+
+    // whether the format stores the values as they are, the 8 bit formats clamp them to [0, 1] and gamma correct
+    virtual bool keeps_values() const { return false; }
+};
+
+// gamma corrected 8 bit rgb, 3 bytes per pixel
+inline std::vector<uint8_t> to_rgb8(const color *image, int width, int height, thread_pool *pool)
+{
+    std::vector<uint8_t> rgb(3 * static_cast<size_t>(width) * height);
+    for_each_line(height, pool, [&](int j)
+                  {
+        const color *source = image + static_cast<size_t>(j) * width;
+        uint8_t *line = &rgb[3 * static_cast<size_t>(j) * width];
+        for (int i = 0; i < width; i++)
+        {
+            line[3 * i + 0] = component_to_byte(source[i].x());
+            line[3 * i + 1] = component_to_byte(source[i].y());
+            line[3 * i + 2] = component_to_byte(source[i].z());
+        } });
+    return rgb;
+}
+
+// binary ppm (P6), 8 bit gamma corrected
+class ppm_writer : public image_writer
+{
+public:
+    bool write(std::ostream &out, const color *image, int width, int height, thread_pool *pool) const override
+    {
+        std::vector<uint8_t> rgb = to_rgb8(image, width, height, pool);
+        out << "P6\n" << width << " " << height << "\n255\n";
+        out.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+        return static_cast<bool>(out);
+    }
+};
+
+// portable float map, keeps the linear values above 1 for hdr tools. Lines are stored bottom up, the negative scale
+// marks little endian floats. Single channels are written as greyscale (Pf).
+class pfm_writer : public image_writer
+{
+public:
+    bool write(std::ostream &out, const color *image, int width, int height, thread_pool *pool) const override
+    {
+        std::vector<float> data(3 * static_cast<size_t>(width) * height);
+        for_each_line(height, pool, [&](int j)
+                      {
+            const color *source = image + static_cast<size_t>(height - 1 - j) * width;
+            float *line = &data[3 * static_cast<size_t>(j) * width];
+            for (int i = 0; i < width; i++)
+            {
+                line[3 * i + 0] = static_cast<float>(source[i].x());
+                line[3 * i + 1] = static_cast<float>(source[i].y());
+                line[3 * i + 2] = static_cast<float>(source[i].z());
+            } });
+        return write_floats(out, data, 3, width, height);
+    }
+
+    bool write_channels(std::ostream &out, const float *const *planes, int channels, int width, int height,
+                        thread_pool *pool) const override
+    {
+        std::vector<float> data(static_cast<size_t>(channels) * width * height);
+        for_each_line(height, pool, [&](int j)
+                      {
+            size_t source = static_cast<size_t>(height - 1 - j) * width;
+            float *line = &data[static_cast<size_t>(channels) * j * width];
+            for (int i = 0; i < width; i++)
+                for (int c = 0; c < channels; c++)
+                    line[channels * i + c] = planes[c][source + i]; });
+        return write_floats(out, data, channels, width, height);
+    }
+
+    bool keeps_values() const override { return true; }
+
+private:
+    // data holds the interleaved channels of the lines, bottom up
+    static bool write_floats(std::ostream &out, std::vector<float> &data, int channels, int width, int height)
+    {
+        if (!little_endian())
+        {
+            for (float &value : data)
+            {
+                uint8_t bytes[4];
+                std::memcpy(bytes, &value, 4);
+                std::reverse(bytes, bytes + 4);
+                std::memcpy(&value, bytes, 4);
+            }
+        }
+        out << (channels == 1 ? "Pf\n" : "PF\n") << width << " " << height << "\n-1.0\n";
+        out.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(float));
+        return static_cast<bool>(out);
+    }
+
+    static bool little_endian()
+    {
+        uint16_t probe = 1;
+        uint8_t first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+};
+
+// "quite ok image format" (qoiformat.org): lossless and a lot smaller than ppm, encodes in a single pass
+class qoi_writer : public image_writer
+{
+public:
+    bool write(std::ostream &out, const color *image, int width, int height, thread_pool *pool) const override
+    {
+        std::vector<uint8_t> rgb = to_rgb8(image, width, height, pool);
+
+        std::vector<uint8_t> data;
+        data.reserve(rgb.size() / 2);
+        const char magic[4] = {'q', 'o', 'i', 'f'};
+        data.insert(data.end(), magic, magic + 4);
+        put_u32(data, width);
+        put_u32(data, height);
+        data.push_back(3); // rgb
+        data.push_back(0); // srgb
+
+        std::array<uint32_t, 64> seen{}; // previously seen pixels, indexed by hash
+        uint8_t pr = 0, pg = 0, pb = 0;  // previous pixel, starts as opaque black
+        int run = 0;
+        size_t pixel_count = static_cast<size_t>(width) * height;
+        for (size_t p = 0; p < pixel_count; p++)
+        {
+            uint8_t r = rgb[3 * p], g = rgb[3 * p + 1], b = rgb[3 * p + 2];
+            if (r == pr && g == pg && b == pb)
+            {
+                if (++run == 62 || p + 1 == pixel_count)
+                {
+                    data.push_back(static_cast<uint8_t>(0xc0 | (run - 1))); // QOI_OP_RUN
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                data.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+                run = 0;
+            }
+
+            int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+            uint32_t packed = (static_cast<uint32_t>(r) << 16) | (g << 8) | b;
+            if (seen[hash] == (packed | 0xff000000u))
+                data.push_back(static_cast<uint8_t>(hash)); // QOI_OP_INDEX
+            else
+            {
+                seen[hash] = packed | 0xff000000u;
+                int dr = static_cast<int8_t>(r - pr), dg = static_cast<int8_t>(g - pg), db = static_cast<int8_t>(b - pb);
+                int dr_dg = dr - dg, db_dg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    data.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2))); // QOI_OP_DIFF
+                else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+                {
+                    data.push_back(static_cast<uint8_t>(0x80 | (dg + 32))); // QOI_OP_LUMA
+                    data.push_back(static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8)));
+                }
+                else
+                {
+                    data.push_back(0xfe); // QOI_OP_RGB
+                    data.push_back(r);
+                    data.push_back(g);
+                    data.push_back(b);
+                }
+            }
+            pr = r;
+            pg = g;
+            pb = b;
+        }
+        const uint8_t end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+        data.insert(data.end(), end_marker, end_marker + 8);
+
+        out.write(reinterpret_cast<const char *>(data.data()), data.size());
+        return static_cast<bool>(out);
+    }
+
+private:
+    static void put_u32(std::vector<uint8_t> &data, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            data.push_back(static_cast<uint8_t>(value >> shift));
+    }
+};
+
+// png without an external zlib: the deflate stream only uses uncompressed blocks, so the file is about as big as a ppm
+// but opens everywhere
+class png_writer : public image_writer
+{
+public:
+    bool write(std::ostream &out, const color *image, int width, int height, thread_pool *pool) const override
+    {
+        std::vector<uint8_t> rgb = to_rgb8(image, width, height, pool);
+
+        // every line starts with its filter type, 0 leaves the bytes as they are
+        size_t line_size = 3 * static_cast<size_t>(width);
+        std::vector<uint8_t> filtered((line_size + 1) * height);
+        for_each_line(height, pool, [&](int j)
+                      {
+            uint8_t *line = &filtered[(line_size + 1) * j];
+            line[0] = 0;
+            std::memcpy(line + 1, &rgb[line_size * j], line_size); });
+
+        const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        out.write(reinterpret_cast<const char *>(signature), 8);
+
+        std::vector<uint8_t> header;
+        put_u32(header, width);
+        put_u32(header, height);
+        header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit rgb, deflate, adaptive filtering, no interlace
+        write_chunk(out, "IHDR", header);
+        write_chunk(out, "IDAT", stored_zlib(filtered));
+        write_chunk(out, "IEND", {});
+        return static_cast<bool>(out);
+    }
+
+private:
+    static void put_u32(std::vector<uint8_t> &data, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            data.push_back(static_cast<uint8_t>(value >> shift));
+    }
+
+    static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc)
+    {
+        static const std::array<uint32_t, 256> table = []
+        {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return crc;
+    }
+
+    static void write_chunk(std::ostream &out, const char *type, const std::vector<uint8_t> &data)
+    {
+        std::vector<uint8_t> head;
+        put_u32(head, static_cast<uint32_t>(data.size()));
+        head.insert(head.end(), type, type + 4);
+        out.write(reinterpret_cast<const char *>(head.data()), head.size());
+        out.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+        uint32_t crc = crc32(head.data() + 4, 4, 0xffffffffu);
+        crc = crc32(data.data(), data.size(), crc) ^ 0xffffffffu;
+        std::vector<uint8_t> tail;
+        put_u32(tail, crc);
+        out.write(reinterpret_cast<const char *>(tail.data()), tail.size());
+    }
+
+    // zlib stream made of uncompressed deflate blocks of at most 65535 bytes
+    static std::vector<uint8_t> stored_zlib(const std::vector<uint8_t> &data)
+    {
+        std::vector<uint8_t> z;
+        z.reserve(data.size() + data.size() / 65535 * 5 + 16);
+        z.push_back(0x78); // deflate, 32k window
+        z.push_back(0x01); // no preset dictionary, header checksum
+        size_t pos = 0;
+        do
+        {
+            size_t block = std::min<size_t>(65535, data.size() - pos);
+            bool last = pos + block == data.size();
+            z.push_back(last ? 1 : 0);
+            z.push_back(static_cast<uint8_t>(block));
+            z.push_back(static_cast<uint8_t>(block >> 8));
+            z.push_back(static_cast<uint8_t>(~block));
+            z.push_back(static_cast<uint8_t>(~block >> 8));
+            z.insert(z.end(), data.begin() + pos, data.begin() + pos + block);
+            pos += block;
+        } while (pos < data.size());
+
+        // adler32 of the uncompressed data
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        put_u32(z, (b << 16) | a);
+        return z;
+    }
+};
+
+// position of the dot that starts the extension of a file name, npos if there is none. Dots of directories don't
+// count, ./out has no extension.
+inline size_t extension_dot(const std::string &filename)
+{
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return std::string::npos;
+    return dot;
+}
+
+// the file an aov is written to next to the image: out.png becomes out.depth.png
+inline std::string aov_filename(const std::string &image_file, aov a)
+{
+    size_t dot = extension_dot(image_file);
+    if (dot == std::string::npos)
+        return image_file + "." + aov_name(a);
+    return image_file.substr(0, dot) + "." + aov_name(a) + image_file.substr(dot);
+}
+
+// picks the writer from the file extension (.ppm, .pfm, .qoi, .png), unknown extensions are written as ppm
+inline std::unique_ptr<image_writer> make_image_writer(const std::string &filename)
+{
+    std::string extension;
+    size_t dot = extension_dot(filename);
+    if (dot != std::string::npos)
+        extension = filename.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+
+    if (extension == "pfm")
+        return std::make_unique<pfm_writer>();
+    if (extension == "qoi")
+        return std::make_unique<qoi_writer>();
+    if (extension == "png")
+        return std::make_unique<png_writer>();
+    if (extension != "ppm")
+        std::cerr << "Unknown image format \"" << extension << "\", writing " << filename << " as ppm\n";
+    return std::make_unique<ppm_writer>();
+}
+
+// writes the image in the format matching the file extension
+inline bool write_image(const std::string &filename, const color *image, int width, int height, thread_pool *pool = nullptr)
+{
+    std::ofstream out(filename, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Could not open " << filename << " for writing\n";
+        return false;
+    }
+    if (!make_image_writer(filename)->write(out, image, width, height, pool))
+    {
+        std::cerr << "Could not write " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Maps the values of an aov to [0, 1] for the 8 bit formats: depth and ray count relative to their maximum, normals
+// from [-1, 1] and every object id to a color of its own (black for the sky). Albedos already are colors. The values
+// are squared because the 8 bit writers gamma correct, so the ramps stay linear.
+inline std::vector<std::vector<float>> aov_display(aov a, const float *const *planes, size_t pixel_count)
+{
+    int channels = a == aov::object_id ? 3 : aov_channels(a);
+    std::vector<std::vector<float>> display(channels, std::vector<float>(pixel_count));
+    float scale = 1;
+    if (a == aov::depth || a == aov::ray_count)
+        scale = 1 / std::max(*std::max_element(planes[0], planes[0] + pixel_count), 1e-6f);
+    for (size_t p = 0; p < pixel_count; p++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            float v;
+            if (a == aov::albedo)
+                v = planes[c][p];
+            else if (a == aov::normal)
+                v = 0.5f * planes[c][p] + 0.5f;
+            else if (a == aov::object_id)
+                v = planes[0][p] < 0 ? 0 : 0.2f + 0.8f * (mix64(static_cast<uint64_t>(planes[0][p]) + c * golden_gamma) >> 40) * 0x1p-24f;
+            else
+                v = scale * planes[0][p];
+            display[c][p] = a == aov::albedo ? v : v * v;
+        }
+    }
+    return display;
+}
+
+// writes one aov in the format matching the file extension, planes holds one pointer per channel. Float formats get
+// the values as they are, the others the viewable version of aov_display.
+inline bool write_aov(const std::string &filename, aov a, const float *const *planes, int width, int height,
+                      thread_pool *pool = nullptr)
+{
+    std::ofstream out(filename, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Could not open " << filename << " for writing\n";
+        return false;
+    }
+    auto writer = make_image_writer(filename);
+    bool written;
+    if (writer->keeps_values())
+        written = writer->write_channels(out, planes, aov_channels(a), width, height, pool);
+    else
+    {
+        auto display = aov_display(a, planes, static_cast<size_t>(width) * height);
+        const float *display_planes[3];
+        for (size_t c = 0; c < display.size(); c++)
+            display_planes[c] = display[c].data();
+        written = writer->write_channels(out, display_planes, static_cast<int>(display.size()), width, height, pool);
+    }
+    if (!written)
+    {
+        std::cerr << "Could not write " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -3,26 +3,40 @@
 
 #include "rtweekend.hh"
 
-class interval
+template <typename T>
+class basic_interval
 {
 public:
-    double min, max;
+    T min, max;
 
-    interval() : min(+infinity), max(-infinity) {} // default intervall is empty
+    basic_interval() : min(+std::numeric_limits<T>::infinity()), max(-std::numeric_limits<T>::infinity()) {} // default intervall is empty
 
-    interval(double _min, double _max) : min(_min), max(_max) {}
+    basic_interval(T _min, T _max) : min(_min), max(_max) {}
 
-    bool contains(double x) const
+    basic_interval(const basic_interval &a, const basic_interval &b) : min(std::fmin(a.min, b.min)), max(std::fmax(a.max, b.max)) {} // smallest interval enclosing both
+
+    T size() const
+    {
+        return max - min;
+    }
+
+    basic_interval expand(T delta) const
+    {
+        auto padding = delta / 2;
+        return basic_interval(min - padding, max + padding);
+    }
+
+    bool contains(T x) const
     {
         return min <= x && x <= max;
     }
 
-    bool surrounds(double x) const
+    bool surrounds(T x) const
     {
         return min < x && x < max;
     }
 
-    double clamp(double x) const
+    T clamp(T x) const
     {
         if (x < min)
             return min;
@@ -30,10 +44,10 @@ public:
             return max;
         return x;
     }
-
-    static const interval empty, universe;
 };
 
+using interval = basic_interval<double>;
+
 const static interval empty(+infinity, -infinity);
 const static interval universe(-infinity, +infinity);
 
@@ -0,0 +1,233 @@
+#ifndef LINEAR_BVH_HH
+#define LINEAR_BVH_HH
+
+#include "rtweekend.hh"
+
+#include "bvh.hh"
+#include "hittable.hh"
+#include "hittable_list.hh"
+#include "packed_spheres.hh"
+#include "sphere.hh"
+
+#include <cstdint>
+#include <vector>
+
+// one node of the flattened bvh, two nodes share a 64 byte cache line
+struct alignas(32) linear_bvh_node
+{
+    float bounds_min[3]; // box in float precision, rounded outwards so it always encloses the exact box
+    float bounds_max[3];
+    int32_t offset;           // leaf: first primitive, interior: index of the second child (first child follows directly)
+    uint16_t primitive_count; // 0 for interior nodes
+    uint8_t axis;             // split axis of interior nodes, decides which child is nearer
+    uint8_t padding;
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node has to fill exactly half a cache line");
+
+// bvh stored as one contiguous array in depth-first order. Leaves index into packed spheres that are sorted so each
+// leaf references one consecutive range, starting on a group so the whole leaf is tested with one simd pass. Traversal is iterative with a small fixed stack and visits the
+// nearer child first. Objects that are not spheres are kept in a plain list and tested after the tree.
+template <typename T>
+class basic_linear_bvh final : public basic_hittable<T>
+{
+public:
+    basic_linear_bvh(const basic_hittable_list<T> &list)
+    {
+        std::vector<basic_sphere<T>> unsorted;
+        std::vector<int> sphere_ids; // index of every sphere in the list
+        for (size_t i = 0; i < list.objects.size(); i++)
+        {
+            const auto &object = list.objects[i];
+            if (auto s = dynamic_cast<const basic_sphere<T> *>(object.get()))
+            {
+                unsorted.push_back(*s);
+                sphere_ids.push_back(static_cast<int>(i));
+            }
+            else
+            {
+                others.add(object);
+                other_ids.push_back(static_cast<int>(i));
+            }
+        }
+
+        bbox = others.bounding_box();
+        if (unsorted.empty())
+            return;
+
+        std::vector<int> indices(unsorted.size());
+        std::vector<basic_aabb<T>> boxes(unsorted.size());
+        for (size_t i = 0; i < unsorted.size(); i++)
+        {
+            indices[i] = static_cast<int>(i);
+            boxes[i] = unsorted[i].bounding_box();
+        }
+
+        nodes.reserve(2 * unsorted.size());
+        build(indices, boxes, 0, indices.size(), 0);
+
+        // pack spheres in leaf order, every leaf starts a new group
+        for (auto &node : nodes)
+        {
+            if (node.primitive_count == 0)
+                continue;
+            int first = static_cast<int>(spheres.size());
+            for (int i = node.offset; i < node.offset + node.primitive_count; i++)
+            {
+                const basic_sphere<T> &s = unsorted[indices[i]];
+                spheres.add(s.center_point(), s.radius_length(), s.material_ptr(), sphere_ids[indices[i]]);
+            }
+            spheres.end_group();
+            node.offset = first;
+        }
+    }
+
+    bool hit(const basic_ray<T> &r, basic_interval<T> ray_t, basic_hit_record<T> &rec) const override
+    {
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+
+        if (!nodes.empty())
+        {
+            const basic_point3<T> origin = r.origin();
+            const basic_vec3<T> inv_dir(1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z());
+            const bool dir_is_neg[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+            int stack[max_tree_depth];
+            int stack_size = 0;
+            int current = 0;
+            while (true)
+            {
+                const linear_bvh_node &node = nodes[current];
+                if (node_hit(node, origin, inv_dir, ray_t.min, closest_so_far))
+                {
+                    if (node.primitive_count > 0)
+                    {
+                        if (spheres.hit(r, node.offset, node.primitive_count, basic_interval<T>(ray_t.min, closest_so_far), rec))
+                        {
+                            hit_anything = true;
+                            closest_so_far = rec.t;
+                        }
+                        if (stack_size == 0)
+                            break;
+                        current = stack[--stack_size];
+                    }
+                    else if (dir_is_neg[node.axis])
+                    {
+                        // ray travels towards the negative side, so the second child is nearer
+                        stack[stack_size++] = current + 1;
+                        current = node.offset;
+                    }
+                    else
+                    {
+                        stack[stack_size++] = node.offset;
+                        current = current + 1;
+                    }
+                }
+                else
+                {
+                    if (stack_size == 0)
+                        break;
+                    current = stack[--stack_size];
+                }
+            }
+        }
+
+        if (!others.objects.empty() && others.hit(r, basic_interval<T>(ray_t.min, closest_so_far), rec))
+        {
+            rec.object_id = other_ids[rec.object_id]; // index in others to index in the list the bvh was built from
+            hit_anything = true;
+        }
+
+        return hit_anything;
+    }
+
+    basic_aabb<T> bounding_box() const override { return bbox; }
+
+    size_t node_count() const { return nodes.size(); }
+
+private:
+    static constexpr int max_tree_depth = 64;  // size of the traversal stack, deeper subtrees become leaves
+    static constexpr int max_leaf_size = basic_packed_spheres<T>::group_size; // ranges of up to one simd group become leaves
+
+    std::vector<linear_bvh_node> nodes;
+    basic_packed_spheres<T> spheres;
+    basic_hittable_list<T> others;
+    std::vector<int> other_ids; // index in the original list of every object in others
+    basic_aabb<T> bbox;
+
+    static float round_down(T x)
+    {
+        float f = static_cast<float>(x);
+        return f > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static float round_up(T x)
+    {
+        float f = static_cast<float>(x);
+        return f < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static bool node_hit(const linear_bvh_node &node, const basic_point3<T> &origin, const basic_vec3<T> &inv_dir, T t_min, T t_max)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            auto t0 = (node.bounds_min[a] - origin[a]) * inv_dir[a];
+            auto t1 = (node.bounds_max[a] - origin[a]) * inv_dir[a];
+            if (inv_dir[a] < 0)
+                std::swap(t0, t1);
+
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max <= t_min)
+                return false;
+        }
+        return true;
+    }
+
+    // appends the subtree of [start, end) in depth-first order and returns the index of its root
+    int build(std::vector<int> &indices, const std::vector<basic_aabb<T>> &boxes, size_t start, size_t end, int depth)
+    {
+        basic_aabb<T> node_box, centroid_bounds;
+        for (size_t i = start; i < end; i++)
+        {
+            auto c = boxes[indices[i]].centroid();
+            node_box = basic_aabb<T>(node_box, boxes[indices[i]]);
+            centroid_bounds = basic_aabb<T>(centroid_bounds, basic_aabb<T>(c, c));
+        }
+        if (depth == 0)
+            bbox = basic_aabb<T>(bbox, node_box);
+
+        int index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+        for (int a = 0; a < 3; a++)
+        {
+            nodes[index].bounds_min[a] = round_down(node_box.axis(a).min);
+            nodes[index].bounds_max[a] = round_up(node_box.axis(a).max);
+        }
+
+        // up to one group of spheres is tested in a single simd pass, which is cheaper than visiting two more nodes.
+        // Deeper subtrees also become leaves so the traversal stack can't overflow.
+        size_t count = end - start;
+        bool make_leaf = count <= max_leaf_size || depth + 1 >= max_tree_depth;
+        if (make_leaf)
+        {
+            nodes[index].offset = static_cast<int32_t>(start);
+            nodes[index].primitive_count = static_cast<uint16_t>(count);
+            return index;
+        }
+
+        size_t mid = sah_partition(indices, start, end, [&](int i)
+                                   { return boxes[i]; });
+        nodes[index].axis = static_cast<uint8_t>(centroid_bounds.longest_axis()); // same axis the sah split along
+        nodes[index].primitive_count = 0;
+        build(indices, boxes, start, mid, depth + 1);
+        int second = build(indices, boxes, mid, end, depth + 1);
+        nodes[index].offset = second;
+        return index;
+    }
+};
+
+using linear_bvh = basic_linear_bvh<double>;
+
+#endif
@@ -3,92 +3,149 @@
 
 #include "rtweekend.hh"
 #include "hittable.hh"
+#include "sampler.hh"
+
+#include <cstdint>
 
 using color = vec3;
 
-class material
+template <typename T>
+using basic_color = basic_vec3<T>;
+
+// the built-in materials, scatter() below dispatches on it without a virtual call
+enum class material_kind : uint8_t
+{
+    lambertian,
+    metal,
+    dielectric,
+    custom // any other material, reached through the virtual scatter
+};
+
+template <typename T>
+class basic_material
 {
 public:
-    virtual ~material() = default;
+    virtual ~basic_material() = default;
+
+    virtual bool scatter(const basic_ray<T> &r_in, const basic_hit_record<T> &rec, basic_color<T> &attenuation,
+                         basic_ray<T> &scattered, const sampler &gen) const = 0;
+
+    material_kind kind() const { return tag; }
 
-    virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const = 0;
+protected:
+    basic_material(material_kind _tag = material_kind::custom) : tag(_tag) {}
+
+private:
+    material_kind tag;
 };
 
-class lambertian : public material
+template <typename T>
+class basic_lambertian final : public basic_material<T>
 {
 public:
-    lambertian(const color &a) : albedo(a) {}
+    basic_lambertian(const basic_color<T> &a) : basic_material<T>(material_kind::lambertian), albedo(a) {}
 
-    bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override
+    bool scatter(const basic_ray<T> &r_in, const basic_hit_record<T> &rec, basic_color<T> &attenuation,
+                 basic_ray<T> &scattered, const sampler &gen) const override
     {
-        auto scatter_direction = rec.normal + random_unit_vector();
+        sample_2d u = gen.get_2d(sampler::direction);
+        auto scatter_direction = rec.normal + unit_vector_from<T>(u.x, u.y);
 
         // Catch degenerate scatter direction
         if (scatter_direction.near_zero())
             scatter_direction = rec.normal;
 
-        scattered = ray(rec.p, scatter_direction);
+        scattered = rec.spawn_ray(scatter_direction);
         attenuation = albedo;
         return true;
     }
 
 private:
-    color albedo;
+    basic_color<T> albedo;
 };
 
-class metal : public material
+template <typename T>
+class basic_metal final : public basic_material<T>
 {
 public:
-    metal(const color &a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+    basic_metal(const basic_color<T> &a, T f) : basic_material<T>(material_kind::metal), albedo(a), fuzz(f < 1 ? f : 1) {}
 
-    bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override
+    bool scatter(const basic_ray<T> &r_in, const basic_hit_record<T> &rec, basic_color<T> &attenuation,
+                 basic_ray<T> &scattered, const sampler &gen) const override
     {
-        vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-        scattered = ray(rec.p, reflected + fuzz * random_unit_vector());
+        basic_vec3<T> reflected = reflect(unit_vector(r_in.direction()), rec.normal);
+        sample_2d u = gen.get_2d(sampler::direction);
+        scattered = rec.spawn_ray(reflected + fuzz * unit_vector_from<T>(u.x, u.y));
         attenuation = albedo;
         return (dot(scattered.direction(), rec.normal) > 0);
     }
 
 private:
-    color albedo;
-    double fuzz;
+    basic_color<T> albedo;
+    T fuzz;
 };
 
-class dielectric : public material
+template <typename T>
+class basic_dielectric final : public basic_material<T>
 {
 public:
-    dielectric(double index_of_refraction) : ir(index_of_refraction) {}
+    basic_dielectric(T index_of_refraction) : basic_material<T>(material_kind::dielectric), ir(index_of_refraction) {}
 
-    bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override
+    bool scatter(const basic_ray<T> &r_in, const basic_hit_record<T> &rec, basic_color<T> &attenuation,
+                 basic_ray<T> &scattered, const sampler &gen) const override
     {
-        attenuation = color(1.0, 1.0, 1.0);
-        double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
+        attenuation = basic_color<T>(1.0, 1.0, 1.0);
+        T refraction_ratio = rec.front_face ? (1 / ir) : ir;
 
-        vec3 unit_direction = unit_vector(r_in.direction());
-        double cos_theta = fmin(dot(-unit_direction, rec.normal), 1.0);
-        double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+        basic_vec3<T> unit_direction = unit_vector(r_in.direction());
+        T cos_theta = std::min(dot(-unit_direction, rec.normal), T(1));
+        T sin_theta = sqrt(1 - cos_theta * cos_theta);
 
-        bool cannot_refract = refraction_ratio * sin_theta > 1.0;
-        vec3 direction;
+        bool cannot_refract = refraction_ratio * sin_theta > 1;
+        basic_vec3<T> direction;
 
-        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > gen.get_1d(sampler::lobe))
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, refraction_ratio);
 
-        scattered = ray(rec.p, direction);
+        scattered = rec.spawn_ray(direction);
         return true;
     }
 
 private:
-    double ir; // Index of Refraction
+    T ir; // Index of Refraction
 
     // Schlick's polynomial relfectance approximation
-    static double reflectance(double cos, double ref_idx)
+    static T reflectance(T cos, T ref_idx)
     {
         auto r0 = (1 - ref_idx) / (1 + ref_idx);
         r0 *= r0;
-        return (r0 + (1 - r0) * pow((1 - cos), 5));
+        return (r0 + (1 - r0) * std::pow((1 - cos), 5));
     }
 };
-#endif
\ No newline at end of file
+
+using material = basic_material<double>;
+using lambertian = basic_lambertian<double>;
+using metal = basic_metal<double>;
+using dielectric = basic_dielectric<double>;
+
+// scatters off any material: the built-in ones are called directly so the compiler can inline them, only custom
+// materials go through the vtable
+template <typename T>
+inline bool scatter(const basic_material<T> &mat, const basic_ray<T> &r_in, const basic_hit_record<T> &rec,
+                    basic_color<T> &attenuation, basic_ray<T> &scattered, const sampler &gen)
+{
+    switch (mat.kind())
+    {
+    case material_kind::lambertian:
+        return static_cast<const basic_lambertian<T> &>(mat).basic_lambertian<T>::scatter(r_in, rec, attenuation, scattered, gen);
+    case material_kind::metal:
+        return static_cast<const basic_metal<T> &>(mat).basic_metal<T>::scatter(r_in, rec, attenuation, scattered, gen);
+    case material_kind::dielectric:
+        return static_cast<const basic_dielectric<T> &>(mat).basic_dielectric<T>::scatter(r_in, rec, attenuation, scattered, gen);
+    default:
+        return mat.scatter(r_in, rec, attenuation, scattered, gen);
+    }
+}
+#endif
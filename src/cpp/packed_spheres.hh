@@ -0,0 +1,342 @@
+#ifndef PACKED_SPHERES_HH
+#define PACKED_SPHERES_HH
+
+#include "rtweekend.hh"
+
+#include "hittable.hh"
+#include "sphere.hh"
+
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PACKED_SPHERES_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PACKED_SPHERES_SSE2 1
+#endif
+
+// One simd register of T and the few operations the sphere test needs, so the kernel below is written once for both
+// precisions: a register holds twice as many floats as doubles. Without simd support only the scalar kernel exists.
+template <typename T>
+struct simd_lanes;
+
+#if defined(PACKED_SPHERES_AVX2)
+template <>
+struct simd_lanes<double>
+{
+    using reg = __m256d;
+    static constexpr int width = 4;
+
+    static reg load(const double *p) { return _mm256_load_pd(p); }
+    static void store(double *p, reg a) { _mm256_store_pd(p, a); }
+    static reg set1(double x) { return _mm256_set1_pd(x); }
+    static reg zero() { return _mm256_setzero_pd(); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+    static reg sqrt(reg a) { return _mm256_sqrt_pd(a); }
+    static reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+    static reg greater(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static reg less(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static reg greater_equal(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static reg bit_and(reg a, reg b) { return _mm256_and_pd(a, b); }
+    static reg bit_or(reg a, reg b) { return _mm256_or_pd(a, b); }
+    static reg select(reg mask, reg a, reg b) { return _mm256_blendv_pd(b, a, mask); } // mask ? a : b
+    static int mask_bits(reg mask) { return _mm256_movemask_pd(mask); }
+};
+
+template <>
+struct simd_lanes<float>
+{
+    using reg = __m256;
+    static constexpr int width = 8;
+
+    static reg load(const float *p) { return _mm256_load_ps(p); }
+    static void store(float *p, reg a) { _mm256_store_ps(p, a); }
+    static reg set1(float x) { return _mm256_set1_ps(x); }
+    static reg zero() { return _mm256_setzero_ps(); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+    static reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+    static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+    static reg greater(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static reg less(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static reg greater_equal(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static reg bit_and(reg a, reg b) { return _mm256_and_ps(a, b); }
+    static reg bit_or(reg a, reg b) { return _mm256_or_ps(a, b); }
+    static reg select(reg mask, reg a, reg b) { return _mm256_blendv_ps(b, a, mask); }
+    static int mask_bits(reg mask) { return _mm256_movemask_ps(mask); }
+};
+#elif defined(PACKED_SPHERES_SSE2)
+template <>
+struct simd_lanes<double>
+{
+    using reg = __m128d;
+    static constexpr int width = 2;
+
+    static reg load(const double *p) { return _mm_load_pd(p); }
+    static void store(double *p, reg a) { _mm_store_pd(p, a); }
+    static reg set1(double x) { return _mm_set1_pd(x); }
+    static reg zero() { return _mm_setzero_pd(); }
+    static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm_div_pd(a, b); }
+    static reg sqrt(reg a) { return _mm_sqrt_pd(a); }
+    static reg max(reg a, reg b) { return _mm_max_pd(a, b); }
+    static reg greater(reg a, reg b) { return _mm_cmpgt_pd(a, b); }
+    static reg less(reg a, reg b) { return _mm_cmplt_pd(a, b); }
+    static reg greater_equal(reg a, reg b) { return _mm_cmpge_pd(a, b); }
+    static reg bit_and(reg a, reg b) { return _mm_and_pd(a, b); }
+    static reg bit_or(reg a, reg b) { return _mm_or_pd(a, b); }
+    static reg select(reg mask, reg a, reg b) { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); } // no blend in sse2
+    static int mask_bits(reg mask) { return _mm_movemask_pd(mask); }
+};
+
+template <>
+struct simd_lanes<float>
+{
+    using reg = __m128;
+    static constexpr int width = 4;
+
+    static reg load(const float *p) { return _mm_load_ps(p); }
+    static void store(float *p, reg a) { _mm_store_ps(p, a); }
+    static reg set1(float x) { return _mm_set1_ps(x); }
+    static reg zero() { return _mm_setzero_ps(); }
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+    static reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+    static reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+    static reg greater(reg a, reg b) { return _mm_cmpgt_ps(a, b); }
+    static reg less(reg a, reg b) { return _mm_cmplt_ps(a, b); }
+    static reg greater_equal(reg a, reg b) { return _mm_cmpge_ps(a, b); }
+    static reg bit_and(reg a, reg b) { return _mm_and_ps(a, b); }
+    static reg bit_or(reg a, reg b) { return _mm_or_ps(a, b); }
+    static reg select(reg mask, reg a, reg b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static int mask_bits(reg mask) { return _mm_movemask_ps(mask); }
+};
+#endif
+
+#if defined(PACKED_SPHERES_AVX2) || defined(PACKED_SPHERES_SSE2)
+#define PACKED_SPHERES_SIMD 1
+#endif
+
+// allocator for std::vector that aligns the first element, so simd loads of whole groups never split a cache line
+template <typename T, size_t Alignment>
+struct aligned_allocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = aligned_allocator<U, Alignment>;
+    };
+
+    aligned_allocator() = default;
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment> &) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T *p, size_t)
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U, Alignment> &) const { return true; }
+    template <typename U>
+    bool operator!=(const aligned_allocator<U, Alignment> &) const { return false; }
+};
+
+// Spheres stored as structure of arrays: every component lives in its own aligned array, so one simd load fetches the
+// same component of a whole group of spheres. Groups of group_size spheres are tested at once, unused slots at the end
+// of a group hold a sphere with negative radius² that no ray can hit.
+template <typename T>
+class basic_packed_spheres
+{
+public:
+    static constexpr int group_size = 32 / sizeof(T); // one avx2 register: 4 doubles or 8 floats
+
+    // appends a sphere and returns its index, object_id is what hits of it report (see basic_hit_record)
+    int add(const basic_point3<T> &center, T radius, const basic_material<T> *mat, int object_id = -1)
+    {
+        center_x.push_back(center.x());
+        center_y.push_back(center.y());
+        center_z.push_back(center.z());
+        radius_squared.push_back(radius * radius);
+        radius_values.push_back(radius);
+
+        auto known = material_lookup.find(mat);
+        if (known == material_lookup.end())
+        {
+            known = material_lookup.emplace(mat, static_cast<uint32_t>(materials.size())).first;
+            materials.push_back(mat);
+        }
+        material_index.push_back(known->second);
+        object_ids.push_back(object_id);
+        return static_cast<int>(center_x.size() - 1);
+    }
+
+    // fills the current group with spheres that are never hit, the next add starts a new group. An infinite negative
+    // radius squared makes c infinite and the discriminant -infinity for any ray, a finite one could still round to a
+    // hit for far away rays in float.
+    void end_group()
+    {
+        while (center_x.size() % group_size != 0)
+        {
+            center_x.push_back(0);
+            center_y.push_back(0);
+            center_z.push_back(0);
+            radius_squared.push_back(-std::numeric_limits<T>::infinity());
+            radius_values.push_back(1);
+            material_index.push_back(0);
+            object_ids.push_back(-1);
+        }
+    }
+
+    size_t size() const { return center_x.size(); }
+
+    // nearest hit of the spheres [first, first + count), first has to start a group
+    bool hit(const basic_ray<T> &r, int first, int count, basic_interval<T> ray_t, basic_hit_record<T> &rec) const
+    {
+        T t;
+        int index = nearest(r, first, count, ray_t.min, ray_t.max, t);
+        if (index < 0)
+            return false;
+
+        set_sphere_hit(r, t, basic_point3<T>(center_x[index], center_y[index], center_z[index]), radius_values[index], rec);
+        rec.mat = materials[material_index[index]];
+        rec.object_id = object_ids[index];
+        return true;
+    }
+
+    // index of the nearest sphere of [first, first + count) hit inside (t_min, t_max) or -1, t receives the distance
+    int nearest(const basic_ray<T> &r, int first, int count, T t_min, T t_max, T &t) const
+    {
+#if defined(PACKED_SPHERES_SIMD)
+        return nearest_simd(r, first, count, t_min, t_max, t);
+#else
+        return nearest_scalar(r, first, count, t_min, t_max, t);
+#endif
+    }
+
+    // one sphere at a time, the same math as sphere::hit
+    int nearest_scalar(const basic_ray<T> &r, int first, int count, T t_min, T t_max, T &t) const
+    {
+        const basic_point3<T> o = r.origin();
+        const basic_vec3<T> d = r.direction();
+        const T a = d.length_squared();
+        int found = -1;
+        for (int i = first; i < first + count; i++)
+        {
+            T ocx = o.x() - center_x[i], ocy = o.y() - center_y[i], ocz = o.z() - center_z[i];
+            T half_b = ocx * d.x() + ocy * d.y() + ocz * d.z();
+            T c = (ocx * ocx + ocy * ocy + ocz * ocz) - radius_squared[i];
+            T discriminant = half_b * half_b - a * c;
+            if (discriminant < 0)
+                continue;
+            T sqrtd = sqrt(discriminant);
+            T root = (-half_b - sqrtd) / a;
+            if (!(t_min < root && root < t_max))
+            {
+                root = (-half_b + sqrtd) / a;
+                if (!(t_min < root && root < t_max))
+                    continue;
+            }
+            t_max = root;
+            found = i;
+        }
+        t = t_max;
+        return found;
+    }
+
+#if defined(PACKED_SPHERES_SIMD)
+    // simd_lanes<T>::width spheres per step, a group takes one avx2 or two sse registers
+    int nearest_simd(const basic_ray<T> &r, int first, int count, T t_min, T t_max, T &t) const
+    {
+        using lanes = simd_lanes<T>;
+        using reg = typename lanes::reg;
+
+        const basic_point3<T> o = r.origin();
+        const basic_vec3<T> d = r.direction();
+        const reg ox = lanes::set1(o.x()), oy = lanes::set1(o.y()), oz = lanes::set1(o.z());
+        const reg dx = lanes::set1(d.x()), dy = lanes::set1(d.y()), dz = lanes::set1(d.z());
+        const reg a = lanes::set1(d.length_squared());
+        const reg lower = lanes::set1(t_min);
+        const reg zero = lanes::zero();
+
+        int found = -1;
+        for (int g = first; g < first + count; g += lanes::width)
+        {
+            reg ocx = lanes::sub(ox, lanes::load(&center_x[g]));
+            reg ocy = lanes::sub(oy, lanes::load(&center_y[g]));
+            reg ocz = lanes::sub(oz, lanes::load(&center_z[g]));
+            // same order of operations as the scalar code, so both find bit-identical distances
+            reg half_b = lanes::add(lanes::add(lanes::mul(ocx, dx), lanes::mul(ocy, dy)), lanes::mul(ocz, dz));
+            reg oc2 = lanes::add(lanes::add(lanes::mul(ocx, ocx), lanes::mul(ocy, ocy)), lanes::mul(ocz, ocz));
+            reg c = lanes::sub(oc2, lanes::load(&radius_squared[g]));
+            reg discriminant = lanes::sub(lanes::mul(half_b, half_b), lanes::mul(a, c));
+            reg has_roots = lanes::greater_equal(discriminant, zero);
+            if (lanes::mask_bits(has_roots) == 0)
+                continue;
+
+            reg sqrtd = lanes::sqrt(lanes::max(discriminant, zero));
+            reg minus_b = lanes::sub(zero, half_b);
+            reg near_root = lanes::div(lanes::sub(minus_b, sqrtd), a);
+            reg far_root = lanes::div(lanes::add(minus_b, sqrtd), a);
+
+            // nearer root if it lies inside the interval, otherwise the farther one
+            reg upper = lanes::set1(t_max);
+            reg near_ok = lanes::bit_and(lanes::greater(near_root, lower), lanes::less(near_root, upper));
+            reg far_ok = lanes::bit_and(lanes::greater(far_root, lower), lanes::less(far_root, upper));
+            reg root = lanes::select(near_ok, near_root, far_root);
+            int hits = lanes::mask_bits(lanes::bit_and(has_roots, lanes::bit_or(near_ok, far_ok)));
+            if (hits == 0)
+                continue;
+
+            alignas(32) T roots[lanes::width];
+            lanes::store(roots, root);
+            for (int lane = 0; lane < lanes::width; lane++)
+            {
+                if ((hits >> lane & 1) && roots[lane] < t_max)
+                {
+                    t_max = roots[lane];
+                    found = g + lane;
+                }
+            }
+        }
+        t = t_max;
+        return found;
+    }
+#endif
+
+private:
+    using aligned_values = std::vector<T, aligned_allocator<T, 32>>;
+
+    aligned_values center_x, center_y, center_z;
+    aligned_values radius_squared;
+    aligned_values radius_values; // only needed for the hit point and normal of the nearest hit
+    std::vector<uint32_t> material_index;
+    std::vector<int32_t> object_ids; // only needed for the nearest hit like radius_values
+    std::vector<const basic_material<T> *> materials; // every distinct material once, owned by the scene
+    std::unordered_map<const basic_material<T> *, uint32_t> material_lookup;
+};
+
+using packed_spheres = basic_packed_spheres<double>;
+
+#endif
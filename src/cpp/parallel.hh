@@ -1,51 +1,286 @@
 #ifndef PARALLEL_HH
 #define PARALLEL_HH
 
+#include "aov.hh"
+#include "thread_pool.hh"
 #include "vec3.hh"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <new>
 #include <thread>
 #include <vector>
 
-#include <mutex>
-
 using color = vec3;
 
-class image_memory
+// one channel of an image, stored line by line. Every line starts on a cache line, so threads writing neighbouring lines
+// or neighbouring tiles (see scheduler.hh) never share a cache line.
+template <typename T>
+class image_plane
+{
+public:
+    image_plane() {}
+
+    ~image_plane()
+    {
+        ::operator delete(storage, std::align_val_t(cache_line_size));
+    }
+
+    image_plane(const image_plane &) = delete;
+    image_plane &operator=(const image_plane &) = delete;
+
+    void allocate(int width, int height, int line_stride)
+    {
+        rows = width;
+        stride = line_stride;
+        storage = static_cast<T *>(::operator new(sizeof(T) * stride * height, std::align_val_t(cache_line_size)));
+        lines = height;
+        std::fill(storage, storage + stride * lines, T());
+    }
+
+    bool allocated() const { return storage != nullptr; }
+
+    // one line without its padding, for saving and restoring the plane
+    size_t line_bytes() const { return sizeof(T) * rows; }
+    void save_line(int line, uint8_t *out) const { std::memcpy(out, storage + line * stride, line_bytes()); }
+    void load_line(int line, const uint8_t *in) { std::memcpy(storage + line * stride, in, line_bytes()); }
+
+    T &at(int line, int row) { return storage[line * stride + row]; }
+    const T &at(int line, int row) const { return storage[line * stride + row]; }
+
+    // removes the padding so the plane is stored without gaps, only call once all threads are done writing
+    T *compact()
+    {
+        if (stride != rows)
+        {
+            for (int line = 1; line < lines; line++)
+                std::memmove(storage + line * rows, storage + line * stride, sizeof(T) * rows);
+            stride = rows;
+        }
+        return storage;
+    }
+
+    static constexpr size_t cache_line_size = 64;
+
+private:
+    T *storage = nullptr;
+    int lines = 0;
+    int rows = 0;
+    int stride = 0;
+};
+
+// accumulated samples of a render, T is the precision of the sums
+template <typename T>
+class basic_image_memory
 {
 public:
-    image_memory(int render_width, int render_height) : lines(render_height), rows(render_width)
+    // pixels per line are rounded up to a multiple of this, 16 pixels fill whole cache lines for every plane type
+    static constexpr int pixel_alignment = 16;
+
+    // aovs are the extra channels to keep per pixel, the denoiser needs depth, normal and albedo
+    basic_image_memory(int render_width, int render_height, bool track_luminance = false, aov_set aovs = 0)
+        : lines(render_height), rows(render_width)
+    {
+        int stride = (rows + pixel_alignment - 1) / pixel_alignment * pixel_alignment;
+        colors.allocate(rows, lines, stride);
+        counts.allocate(rows, lines, stride);
+        if (track_luminance)
+        {
+            luminance.allocate(rows, lines, stride);
+            luminance_squared.allocate(rows, lines, stride);
+        }
+        for (int i = 0; i < static_cast<int>(aov::count); i++)
+        {
+            aov a = static_cast<aov>(i);
+            if (has_aov(aovs, a))
+                for (int c = 0; c < aov_channels(a); c++)
+                    aov_planes[aov_first_channel(a) + c].allocate(rows, lines, stride);
+        }
+    }
+
+    // adds the sum of some samples to a pixel
+    // no lock needed: every pixel is handed to exactly one thread per pass (see scheduler.hh) and lines don't share cache lines
+    void add_to_pixel(int line, int row, const basic_vec3<T> &pixel_color, int samples)
+    {
+        colors.at(line, row) += pixel_color;
+        counts.at(line, row) += samples;
+    }
+
+    // adds the sum and the sum of squares of the luminance of some samples, only if tracking was enabled
+    void add_luminance(int line, int row, T sum, T squared_sum)
     {
-        linesLeft = lines;
-        shared_storage = new color[lines * rows];
+        luminance.at(line, row) += sum;
+        luminance_squared.at(line, row) += squared_sum;
     }
 
-    void write_pixel(int line, int row, color pixel_color)
+    bool tracks(aov a) const
     {
-        std::lock_guard<std::mutex> guard(lock_img);
-        shared_storage[(line - 1) * rows + row] = pixel_color;
+        return aov_planes[aov_first_channel(a)].allocated();
     }
 
-    int get_render_line()
+    // one channel of an aov of a pixel, only if it is tracked. Holds the sum over the samples for depth, normal, albedo
+    // and ray count. Like the color no lock is needed.
+    float &aov_value(aov a, int channel, int line, int row)
     {
-        std::lock_guard<std::mutex> guard(lock_line);
-        std::clog << "\rScanlines remaining: " << fmax(linesLeft, 0) << std::flush;
-        return (lines - (--linesLeft));
+        return aov_planes[aov_first_channel(a) + channel].at(line, row);
     }
 
-    color *get_image()
+    // sum of all samples of a pixel so far, only valid between passes
+    const basic_vec3<T> &pixel(int line, int row) const
     {
-        std::lock_guard<std::mutex> guard(lock_img);
-        return shared_storage;
+        return colors.at(line, row);
+    }
+
+    int samples(int line, int row) const
+    {
+        return counts.at(line, row);
+    }
+
+    // like pixel() only valid between passes
+    float aov_value(aov a, int channel, int line, int row) const
+    {
+        return aov_planes[aov_first_channel(a) + channel].at(line, row);
+    }
+
+    // variance of the mean luminance of a pixel, negative while it has fewer than two samples
+    double luminance_variance(int line, int row) const
+    {
+        double n = counts.at(line, row);
+        if (n < 2)
+            return -1;
+        double mean = luminance.at(line, row) / n;
+        return fmax(0.0, (static_cast<double>(luminance_squared.at(line, row)) - n * mean * mean) / (n - 1)) / n;
+    }
+
+    // standard error of the mean luminance relative to the luminance, estimates how noisy a pixel still is
+    double relative_error(int line, int row) const
+    {
+        double variance = luminance_variance(line, row);
+        if (variance < 0)
+            return infinity;
+        double mean = luminance.at(line, row) / counts.at(line, row);
+        return sqrt(variance) / fmax(mean, 1e-3);
+    }
+
+    int width() const { return rows; }
+    int height() const { return lines; }
+
+    // only call once all render threads have been joined: returns the mean color of every pixel line by line
+    basic_vec3<T> *get_image()
+    {
+        get_sample_counts();
+        basic_vec3<T> *image = colors.compact();
+        if (!averaged)
+        {
+            for (int i = 0; i < rows * lines; i++)
+                if (sample_counts[i] > 0)
+                    image[i] /= static_cast<T>(sample_counts[i]);
+            averaged = true;
+        }
+        return image;
+    }
+
+    // only call once all render threads have been joined: returns one channel of a tracked aov line by line. Depth,
+    // normal and albedo are the means over the samples, normals have length 1 again. Object ids and ray counts are kept.
+    float *get_aov(aov a, int channel)
+    {
+        get_sample_counts();
+        float *planes[3];
+        for (int c = 0; c < aov_channels(a); c++)
+            planes[c] = aov_planes[aov_first_channel(a) + c].compact();
+        if (!has_aov(resolved, a) && (a == aov::depth || a == aov::albedo || a == aov::normal))
+        {
+            for (int i = 0; i < rows * lines; i++)
+            {
+                float scale = sample_counts[i] > 0 ? 1.0f / sample_counts[i] : 0.0f;
+                if (a == aov::normal)
+                {
+                    float length = std::sqrt(planes[0][i] * planes[0][i] + planes[1][i] * planes[1][i] + planes[2][i] * planes[2][i]);
+                    scale = length > 0 ? 1 / length : 0;
+                }
+                for (int c = 0; c < aov_channels(a); c++)
+                    planes[c][i] *= scale;
+            }
+        }
+        resolved |= aov_bit(a);
+        return planes[channel];
+    }
+
+    // bytes of the sums and sample counts of all planes without the line padding, what a checkpoint stores
+    size_t state_size() const
+    {
+        size_t size = 0;
+        for_each_plane(*this, [&](const auto &plane)
+                       { size += plane.line_bytes() * lines; });
+        return size;
+    }
+
+    // copies the state plane after plane into out, split between the workers of pool. Only call between passes.
+    void save_state(uint8_t *out, thread_pool *pool) const
+    {
+        for_each_line(lines, pool, [&](int j)
+                      {
+            uint8_t *plane_start = out;
+            for_each_plane(*this, [&](const auto &plane)
+                           {
+                plane.save_line(j, plane_start + plane.line_bytes() * j);
+                plane_start += plane.line_bytes() * lines; }); });
+    }
+
+    // continues from a state save_state wrote for an image with the same size and planes, false if it doesn't fit
+    bool load_state(const uint8_t *in, size_t size, thread_pool *pool)
+    {
+        if (size != state_size())
+            return false;
+        for_each_line(lines, pool, [&](int j)
+                      {
+            const uint8_t *plane_start = in;
+            for_each_plane(*this, [&](auto &plane)
+                           {
+                plane.load_line(j, plane_start + plane.line_bytes() * j);
+                plane_start += plane.line_bytes() * lines; }); });
+        return true;
+    }
+
+    // only call once all render threads have been joined: returns the samples taken of every pixel line by line
+    uint32_t *get_sample_counts()
+    {
+        sample_counts = counts.compact();
+        return sample_counts;
     }
 
 private:
     int lines;
     int rows;
-    std::mutex lock_img;
-    color *shared_storage;
 
-    int linesLeft;
-    std::mutex lock_line;
+    // calls f with every allocated plane, always in the same order
+    template <typename Memory, typename F>
+    static void for_each_plane(Memory &memory, F f)
+    {
+        f(memory.colors);
+        f(memory.counts);
+        if (memory.luminance.allocated())
+        {
+            f(memory.luminance);
+            f(memory.luminance_squared);
+        }
+        for (auto &plane : memory.aov_planes)
+            if (plane.allocated())
+                f(plane);
+    }
+
+    image_plane<basic_vec3<T>> colors; // sum of all samples
+    image_plane<uint32_t> counts;      // number of samples
+    image_plane<T> luminance;          // sum of sample luminances (adaptive sampling only)
+    image_plane<T> luminance_squared;
+    image_plane<float> aov_planes[aov_channel_count]; // one plane per aov channel, see aov_first_channel
+    uint32_t *sample_counts = nullptr;
+    bool averaged = false;
+    aov_set resolved = 0; // aovs get_aov already turned into means
 };
 
-#endif
\ No newline at end of file
+using image_memory = basic_image_memory<double>;
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef PROGRESS_HH
+#define PROGRESS_HH
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// progress of a running render: written by the render threads, polled by whoever displays it (console, GUI)
+struct render_progress
+{
+    std::atomic<int> work_total{0}; // work items (scanlines or tiles) of the current render
+    std::atomic<int> work_done{0};  // work items that are finished
+    std::atomic<int> samples_done{0}; // samples per pixel of all finished passes
+    std::atomic<bool> running{false};
+    // Both are set by the caller and never reset by start(): a request made while the scene is still being built
+    // belongs to the render that follows, every render gets a fresh render_progress.
+    std::atomic<bool> stop_requested{false};   // a progressive render stops after the current pass
+    std::atomic<bool> cancel_requested{false}; // the render threads stop after their current tile, the image is thrown away
+
+    void start(int total)
+    {
+        work_done.store(0, std::memory_order_relaxed);
+        samples_done.store(0, std::memory_order_relaxed);
+        work_total.store(total, std::memory_order_relaxed);
+        running.store(true, std::memory_order_release);
+    }
+
+    void finish()
+    {
+        running.store(false, std::memory_order_release);
+    }
+
+    double fraction() const
+    {
+        int total = work_total.load(std::memory_order_relaxed);
+        return total > 0 ? static_cast<double>(work_done.load(std::memory_order_relaxed)) / total : 0.0;
+    }
+
+    void request_stop()
+    {
+        stop_requested.store(true, std::memory_order_relaxed);
+    }
+
+    void cancel()
+    {
+        cancel_requested.store(true, std::memory_order_relaxed);
+    }
+
+    bool cancelled() const
+    {
+        return cancel_requested.load(std::memory_order_relaxed);
+    }
+};
+
+// latest image of a render in memory: published by the renderer after the render and after every progressive pass,
+// read by the display without going through a file
+struct render_snapshot
+{
+    std::mutex lock;           // hold while reading the fields below
+    std::vector<uint8_t> rgba; // 8 bit gamma corrected rgba, top line first
+    int width = 0;
+    int height = 0;
+    int samples = 0;                  // samples per pixel the image consists of
+    double denoise_time = 0;          // seconds the denoiser took for the image, 0 if it was not denoised
+    std::atomic<uint64_t> version{0}; // increases with every published pass, lets readers skip unchanged images
+};
+
+// prints the share of finished work to std::clog from its own thread a few times per second, so the render threads never
+// wait for the terminal. Reporting stops when the reporter is destroyed.
+class progress_reporter
+{
+public:
+    progress_reporter(const render_progress &_progress, std::chrono::milliseconds _interval = std::chrono::milliseconds(250))
+        : progress(_progress), interval(_interval)
+    {
+        reporter = std::thread(&progress_reporter::report, this);
+    }
+
+    ~progress_reporter()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_stop);
+            stop = true;
+        }
+        wake.notify_one();
+        reporter.join();
+        print();
+    }
+
+    progress_reporter(const progress_reporter &) = delete;
+    progress_reporter &operator=(const progress_reporter &) = delete;
+
+private:
+    const render_progress &progress;
+    std::chrono::milliseconds interval;
+    std::thread reporter;
+
+    bool stop = false;
+    std::mutex lock_stop;
+    std::condition_variable wake;
+
+    void report()
+    {
+        std::unique_lock<std::mutex> guard(lock_stop);
+        while (!wake.wait_for(guard, interval, [this]
+                              { return stop; }))
+            print();
+    }
+
+    void print() const
+    {
+        std::clog << "\rRendered: " << static_cast<int>(100 * progress.fraction()) << "%   " << std::flush;
+    }
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "render_kernels.hh"
+#include "rtweekend.hh"
+
+#include "camera.hh"
+#include "color.hh"
+#include "hittable_list.hh"
+#include "linear_bvh.hh"
+#include "scene.hh"
+
+// This file is compiled once per instruction set level (see CMakeLists.txt), the build names the entry point of
+// every copy. Without a name it is the baseline copy that is part of every build.
+#ifndef RENDER_KERNELS_ENTRY
+#define RENDER_KERNELS_ENTRY render_kernels_baseline
+#endif
+
+// T is the precision the scene is stored and traced in
+template <typename T>
+static bool render_final_scene(const cpu_render_settings &settings, thread_pool &pool, double &last_render_time)
+{
+    point3 _cam_pos(settings.cam_pos.x, settings.cam_pos.y, settings.cam_pos.z);
+    point3 _focal_point(settings.focal_point.x, settings.focal_point.y, settings.focal_point.z);
+
+    basic_camera<T> cam;
+    cam.aspect_ratio = settings.aspect_ratio;
+    cam.image_height = settings.image_height;
+    cam.samples_per_pixel = settings.samples_per_pixel;
+    cam.max_depth = settings.max_depth;
+    cam.russian_roulette = settings.russian_roulette;
+    cam.roulette_min_depth = settings.roulette_min_depth;
+    cam.vfov = settings.vfov;
+    cam.lookfrom = _cam_pos;
+    cam.lookat = _focal_point;
+    cam.defocus_angle = settings.defocus_angle;
+    cam.pool = &pool;
+    cam.seed = settings.seed;
+    cam.sampling = settings.sampling;
+    cam.output_file = settings.output_file;
+    cam.progress = settings.progress;
+    cam.schedule = settings.schedule;
+    cam.tile_size = settings.tile_size;
+    cam.tile_ordering = settings.tile_ordering;
+    cam.progressive = settings.progressive;
+    cam.snapshot = settings.snapshot;
+    cam.adaptive = settings.adaptive;
+    cam.adaptive_min_samples = settings.adaptive_min_samples;
+    cam.adaptive_threshold = settings.adaptive_threshold;
+    cam.sample_map_file = settings.sample_map_file;
+    cam.denoise = settings.denoise;
+    cam.aovs = settings.aovs;
+    cam.checkpoint_file = settings.checkpoint_file;
+    cam.checkpoint_interval = settings.checkpoint_interval;
+    cam.resume = settings.resume;
+
+    cam.vup = vec3(0, 1, 0);
+    cam.focus_dist = (_cam_pos - _focal_point).length();
+
+    basic_hittable_list<T> world = final_scene<T>();
+
+    // pack the scene into a flat bvh so rays only get tested against objects whose bounding boxes they hit
+    basic_linear_bvh<T> bvh(world);
+
+    return cam.render(bvh, last_render_time);
+}
+
+extern "C" bool RENDER_KERNELS_ENTRY(const cpu_render_settings &settings, thread_pool &pool, double &last_render_time)
+{
+    if (settings.single_precision)
+        return render_final_scene<float>(settings, pool, last_render_time);
+    return render_final_scene<double>(settings, pool, last_render_time);
+}
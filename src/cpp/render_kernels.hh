@@ -0,0 +1,22 @@
+#ifndef RENDER_KERNELS_HH
+#define RENDER_KERNELS_HH
+
+#include "cpu_render.hh"
+#include "thread_pool.hh"
+
+// Everything a cpu render runs per pixel: scene setup, bvh traversal, sphere kernels, scattering and the conversion of
+// the image for the writers. render_kernels.cpp is compiled once for the baseline and, with RAYTRACER_ISA_DISPATCH,
+// once more for each of SSE4.2, AVX2 and AVX-512. Each copy renders settings on pool and returns what
+// cpu_render returns.
+extern "C"
+{
+    bool render_kernels_baseline(const cpu_render_settings &settings, thread_pool &pool, double &last_render_time);
+
+#if defined(RAYTRACER_ISA_DISPATCH)
+    bool render_kernels_sse42(const cpu_render_settings &settings, thread_pool &pool, double &last_render_time);
+    bool render_kernels_avx2(const cpu_render_settings &settings, thread_pool &pool, double &last_render_time);
+    bool render_kernels_avx512(const cpu_render_settings &settings, thread_pool &pool, double &last_render_time);
+#endif
+}
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef RTWEEKEND_HH
 #define RTWEEKEND_HH
 
+#include "hash.hh"
+
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
 
@@ -20,16 +23,55 @@ inline double degrees_to_radians(double degrees)
     return degrees * pi / 180.0;
 }
 
-inline double random_double()
+// Counter-based random number generator: the n-th number of a generator is a hash of its key and n (the SplitMix64
+// finalizer over a Weyl sequence, Steele et al. "Fast splittable pseudorandom number generators"). Nothing depends on
+// numbers drawn before, so a generator is as cheap to make as one draw. Not thread safe, every user owns its own.
+class rng
+{
+public:
+    // generators with the same seed but different streams produce independent sequences
+    rng(uint64_t seed = 0, uint64_t stream = 0) : counter(stream_key(seed, stream)) {}
+
+    // key of a stream, hashed once for a pixel and shared by the generators of all its samples
+    static uint64_t stream_key(uint64_t seed, uint64_t stream)
+    {
+        return mix64(mix64(seed + golden_gamma) ^ stream);
+    }
+
+    // generator of one sample of the stream with the given key, without hashing: sample s starts 2^32 numbers after
+    // sample s - 1 in the Weyl sequence of the key, so the samples never share numbers
+    static rng for_sample(uint64_t key, uint64_t sample)
+    {
+        rng gen;
+        gen.counter = key + (sample << 32) * golden_gamma;
+        return gen;
+    }
+
+    uint64_t next_u64()
+    {
+        counter += golden_gamma;
+        return mix64(counter);
+    }
+
+    uint32_t next_uint()
+    {
+        return static_cast<uint32_t>(next_u64() >> 32);
+    }
+
+private:
+    uint64_t counter; // key plus golden_gamma times the numbers drawn so far
+};
+
+inline double random_double(rng &gen)
 {
-    // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    // Returns a random real in [0,1), all 53 bits of the mantissa are random.
+    return (gen.next_u64() >> 11) * 0x1p-53;
 }
 
-inline double random_double(double min, double max)
+inline double random_double(rng &gen, double min, double max)
 {
     // Returns a random real in [min,max).
-    return min + (max - min) * random_double();
+    return min + (max - min) * random_double(gen);
 }
 
 // Common Headers
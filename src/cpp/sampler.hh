@@ -0,0 +1,273 @@
+#ifndef SAMPLER_HH
+#define SAMPLER_HH
+
+#include "hash.hh"
+
+#include <cmath>
+#include <cstdint>
+
+// how the numbers of the samples of a pixel are spread, see sampler below
+enum class sampler_kind
+{
+    independent, // uniform random numbers, every sample on its own
+    stratified,  // jittered strata over the samples of a pixel, correlated multi-jittered in 2d (Kensler 2013)
+    sobol,       // sobol points, scrambled with a random xor per dimension
+    owen         // sobol points with hash based nested uniform (owen) scrambling (Burley 2020), the least noise
+};
+
+// xor of the sobol direction numbers of every bit set in a byte, for each of the four bytes of an index
+struct sobol_byte_table
+{
+    uint32_t xor_of[4][256];
+};
+
+// The direction numbers of the second sobol dimension are the rows of pascal's triangle mod 2. They are stored with
+// their bits reversed, v_k = v_k-1 ^ (v_k-1 << 1), because the owen scramble works on the reversed bits anyway.
+constexpr sobol_byte_table make_sobol_second_table()
+{
+    sobol_byte_table table{};
+    uint32_t direction[32] = {};
+    direction[0] = 1;
+    for (int k = 1; k < 32; k++)
+        direction[k] = direction[k - 1] ^ (direction[k - 1] << 1);
+    for (int byte = 0; byte < 4; byte++)
+        for (int value = 0; value < 256; value++)
+            for (int bit = 0; bit < 8; bit++)
+                if (value & (1 << bit))
+                    table.xor_of[byte][value] ^= direction[8 * byte + bit];
+    return table;
+}
+
+constexpr sobol_byte_table sobol_second_table = make_sobol_second_table();
+
+struct sample_2d
+{
+    double x, y;
+};
+
+// The numbers of one sample of one pixel, all in [0, 1). Every number has a fixed dimension: the camera takes the
+// dimensions of block 0 and bounce b those of block b + 1, so a dimension means the same thing in every sample of a
+// pixel and a sampler can spread the samples evenly per dimension (pair). Different dimensions get differently
+// scrambled points and don't correlate. Like rng the numbers only depend on the arguments, not on what was drawn before.
+class sampler
+{
+public:
+    // dimensions of the camera block
+    static constexpr int pixel = 0; // 2d, position in the pixel
+    static constexpr int lens = 2;  // 2d, position on the defocus disk
+
+    // dimensions of a bounce block
+    static constexpr int direction = 0; // 2d, scatter direction
+    static constexpr int lobe = 2;      // 1d, reflect or refract
+    static constexpr int roulette = 3;  // 1d, russian roulette
+
+    static constexpr int block_size = 4;
+
+    // sample_index counts the samples of the pixel over all passes, sample_count is the number the pixel is meant to
+    // get (only stratified uses it, later samples start another set of strata)
+    sampler(sampler_kind _kind, uint64_t seed, uint64_t pixel_index, uint32_t _sample_index, uint32_t _sample_count)
+        : sampler(_kind, key_of_pixel(seed, pixel_index), _sample_index, _sample_count)
+    {
+    }
+
+    // the same with the key of the pixel from key_of_pixel, which the samples of a pixel share, so making the sampler
+    // of a sample doesn't hash anything
+    sampler(sampler_kind _kind, uint64_t _pixel_key, uint32_t _sample_index, uint32_t _sample_count)
+        : kind(_kind), sample_index(_sample_index), reversed_index(reverse_bits(_sample_index)),
+          sample_count(_sample_count > 0 ? _sample_count : 1), pixel_key(_pixel_key),
+          sample_key(_pixel_key + (static_cast<uint64_t>(_sample_index) << 32) * golden_gamma)
+    {
+    }
+
+    static uint64_t key_of_pixel(uint64_t seed, uint64_t pixel_index)
+    {
+        return mix64(mix64(seed + golden_gamma) ^ pixel_index);
+    }
+
+    // the following numbers belong to the given bounce, 0 is the first surface the camera ray hits
+    void start_bounce(int bounce)
+    {
+        block = bounce + 1;
+    }
+
+    double get_1d(int dimension) const
+    {
+        int a = block * block_size + dimension;
+        if (kind == sampler_kind::independent)
+            return independent(a);
+        uint64_t key = dimension_key(a);
+        switch (kind)
+        {
+        case sampler_kind::stratified:
+        {
+            uint32_t s = sample_index % sample_count;
+            uint32_t p = static_cast<uint32_t>(mix64(key + sample_index / sample_count));
+            return (permute(s, sample_count, p) + to_unit(mix64(key ^ (static_cast<uint64_t>(s) << 32 | p)))) / sample_count;
+        }
+        case sampler_kind::sobol:
+            return to_unit(sobol_first(shuffled_index(key)) ^ static_cast<uint32_t>(key >> 32));
+        default: // owen, the first sobol dimension only reverses the bits, the scramble works on the reversed bits
+            return to_unit(reverse_bits(laine_karras(shuffled_index(key), static_cast<uint32_t>(key >> 32))));
+        }
+    }
+
+    sample_2d get_2d(int dimension) const
+    {
+        int a = block * block_size + dimension;
+        if (kind == sampler_kind::independent)
+            return {independent(a), independent(a + 1)};
+        uint64_t key = dimension_key(a);
+        switch (kind)
+        {
+        case sampler_kind::stratified:
+            return multi_jittered(key);
+        case sampler_kind::sobol:
+        {
+            uint32_t index = shuffled_index(key);
+            return {to_unit(sobol_first(index) ^ static_cast<uint32_t>(key >> 32)),
+                    to_unit(reverse_bits(sobol_second_reversed(index)) ^ second_seed(key))};
+        }
+        default: // owen
+        {
+            uint32_t index = shuffled_index(key);
+            return {to_unit(reverse_bits(laine_karras(index, static_cast<uint32_t>(key >> 32)))),
+                    to_unit(reverse_bits(laine_karras(sobol_second_reversed(index), second_seed(key))))};
+        }
+        }
+    }
+
+private:
+    sampler_kind kind;
+    uint32_t sample_index;
+    uint32_t reversed_index; // sample_index with the bits reversed
+    uint32_t sample_count;
+    uint64_t pixel_key;  // seed and pixel, the same for all samples of the pixel
+    uint64_t sample_key; // like rng::for_sample, sample s starts 2^32 numbers after sample s - 1, only independent uses it
+    int block = 0;
+
+    // random bits of dimension a of this pixel, the same in every sample
+    uint64_t dimension_key(int a) const
+    {
+        return mix64(pixel_key + static_cast<uint64_t>(a + 1) * golden_gamma);
+    }
+
+    double independent(int a) const
+    {
+        return (mix64(sample_key + static_cast<uint64_t>(a + 1) * golden_gamma) >> 11) * 0x1p-53;
+    }
+
+    static double to_unit(uint32_t bits)
+    {
+        return bits * 0x1p-32;
+    }
+
+    static double to_unit(uint64_t bits)
+    {
+        return (bits >> 11) * 0x1p-53;
+    }
+
+    // every dimension (pair) walks through the sobol points in its own order, otherwise all pairs would take the same
+    // point in the same sample. Owen scrambling the index only reorders aligned blocks of 2^k points, and every such
+    // block is as evenly spread as the first one.
+    uint32_t shuffled_index(uint64_t key) const
+    {
+        return reverse_bits(laine_karras(reversed_index, static_cast<uint32_t>(key)));
+    }
+
+    // the low and high half of a dimension key seed the index shuffle and the first dimension, this the second one
+    static uint32_t second_seed(uint64_t key)
+    {
+        return static_cast<uint32_t>((key * golden_gamma) >> 32);
+    }
+
+    // first two dimensions of the sobol sequence: the first one is the van der corput sequence, together they place one
+    // point in every cell of any 2^a by 2^b grid of the first 2^(a + b) points
+    static uint32_t sobol_first(uint32_t index)
+    {
+        return reverse_bits(index);
+    }
+
+    // xor of the direction numbers of every set bit, looked up a byte at a time: shuffled indices use all 32 bits
+    static uint32_t sobol_second_reversed(uint32_t index)
+    {
+        return sobol_second_table.xor_of[0][index & 0xff] ^ sobol_second_table.xor_of[1][(index >> 8) & 0xff] ^
+               sobol_second_table.xor_of[2][(index >> 16) & 0xff] ^ sobol_second_table.xor_of[3][index >> 24];
+    }
+
+    static uint32_t reverse_bits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    // Laine-Karras style hash: every output bit only depends on the same and lower input bits. Applied to the reversed
+    // bits of a point and reversed back it flips the subtrees of a random binary tree over [0, 1), a nested uniform
+    // (owen) scramble. Constants by N. Vegdahl.
+    static uint32_t laine_karras(uint32_t x, uint32_t seed)
+    {
+        x ^= x * 0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1;
+        x ^= x * 0x05526c56u;
+        x ^= x * 0x53a22864u;
+        return x;
+    }
+
+    // random permutation of [0, length) without a table, cycle walks a bijection on the next power of two (Kensler 2013)
+    static uint32_t permute(uint32_t i, uint32_t length, uint32_t p)
+    {
+        uint32_t w = length - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do
+        {
+            i ^= p;
+            i *= 0xe170893du;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3fu;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;
+            i *= 0x6935fa69u;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303u;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3u;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3dfu;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= length);
+        return (i + p) % length;
+    }
+
+    // correlated multi-jittered sample: one sample per cell of an m by n grid, and the samples of a row or column of
+    // cells are also spread over the sub rows and columns of their cells. m * n is exactly the sample count, a cell
+    // without a sample would bias the pixel, so a prime count falls back to n-rooks in a 1 by n grid.
+    sample_2d multi_jittered(uint64_t key) const
+    {
+        uint32_t m = static_cast<uint32_t>(std::sqrt(static_cast<double>(sample_count)));
+        while (sample_count % m != 0)
+            m--;
+        uint32_t n = sample_count / m;
+        uint32_t p = static_cast<uint32_t>(mix64(key + sample_index / sample_count));
+        uint32_t s = permute(sample_index % sample_count, sample_count, p * 0x51633e2du);
+        uint32_t sx = permute(s % m, m, p * 0xa511e9b3u);
+        uint32_t sy = permute(s / m, n, p * 0x63d83595u);
+        uint64_t jitter = mix64(key ^ (static_cast<uint64_t>(s) << 32 | p));
+        double jx = to_unit(static_cast<uint32_t>(jitter));
+        double jy = to_unit(static_cast<uint32_t>(jitter >> 32));
+        return {(s % m + (sy + jx) / n) / m, (s / m + (sx + jy) / m) / n};
+    }
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef SCENE_HH
+#define SCENE_HH
+
+#include "rtweekend.hh"
+
+#include "color.hh"
+#include "hittable_list.hh"
+#include "material.hh"
+#include "sphere.hh"
+
+// "final scene" of the book: three big spheres on a ground sphere surrounded by (2 * grid)^2 randomly placed small spheres
+// the layout only depends on seed, not on the seed of the render. It is worked out in double precision and only then
+// converted to T, so both precisions render the same spheres.
+template <typename T = double>
+inline basic_hittable_list<T> final_scene(int grid = 11, uint64_t seed = 0)
+{
+    using lambertian = basic_lambertian<T>;
+    using metal = basic_metal<T>;
+    using dielectric = basic_dielectric<T>;
+    using material = basic_material<T>;
+    using sphere = basic_sphere<T>;
+    using color = basic_color<T>;
+
+    basic_hittable_list<T> world;
+    rng gen(seed);
+
+    auto ground_material = world.add_material(make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+    world.add(make_shared<sphere>(basic_point3<T>(0, -1000, 0), 1000, ground_material));
+
+    for (int a = -grid; a < grid; a++)
+    {
+        for (int b = -grid; b < grid; b++)
+        {
+            auto choose_mat = random_double(gen);
+            point3 center(a + 0.9 * random_double(gen), 0.2, b + 0.9 * random_double(gen));
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9)
+            {
+                const material *sphere_material;
+
+                if (choose_mat < 0.8)
+                {
+                    // diffuse
+                    auto albedo = vec3::random(gen) * vec3::random(gen);
+                    sphere_material = world.add_material(make_shared<lambertian>(color(albedo)));
+                    world.add(make_shared<sphere>(basic_point3<T>(center), 0.2, sphere_material));
+                }
+                else if (choose_mat < 0.95)
+                {
+                    // metal
+                    auto albedo = vec3::random(gen, 0.5, 1);
+                    auto fuzz = random_double(gen, 0, 0.5);
+                    sphere_material = world.add_material(make_shared<metal>(color(albedo), fuzz));
+                    world.add(make_shared<sphere>(basic_point3<T>(center), 0.2, sphere_material));
+                }
+                else
+                {
+                    // glass
+                    sphere_material = world.add_material(make_shared<dielectric>(1.5));
+                    world.add(make_shared<sphere>(basic_point3<T>(center), 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = world.add_material(make_shared<dielectric>(1.5));
+    world.add(make_shared<sphere>(basic_point3<T>(0, 1, 0), 1.0, material1));
+
+    auto material2 = world.add_material(make_shared<lambertian>(color(0.4, 0.2, 0.1)));
+    world.add(make_shared<sphere>(basic_point3<T>(-4, 1, 0), 1.0, material2));
+
+    auto material3 = world.add_material(make_shared<metal>(color(0.7, 0.6, 0.5), 0.0));
+    world.add(make_shared<sphere>(basic_point3<T>(4, 1, 0), 1.0, material3));
+
+    return world;
+}
+
+#endif
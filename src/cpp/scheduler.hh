@@ -0,0 +1,184 @@
+#ifndef SCHEDULER_HH
+#define SCHEDULER_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+enum class schedule_mode
+{
+    lines, // whole scanlines from one shared counter
+    tiles  // square tiles from per-thread queues with work stealing
+};
+
+enum class tile_order
+{
+    morton, // z-order curve, neighbouring tiles are rendered close in time
+    spiral  // from the center outwards, the interesting part of the image is done first
+};
+
+// rectangle of pixels [x0, x1) x [y0, y1) that is rendered by one thread
+struct render_tile
+{
+    int x0, y0, x1, y1;
+};
+
+// hands out the work of one render to the render threads
+class render_scheduler
+{
+public:
+    virtual ~render_scheduler() = default;
+
+    // gets the next piece of work for a thread, returns false once there is nothing left
+    virtual bool next(int thread_index, render_tile &tile) = 0;
+
+    // total number of work items
+    virtual int size() const = 0;
+};
+
+class line_scheduler : public render_scheduler
+{
+public:
+    line_scheduler(int _width, int _height) : width(_width), height(_height) {}
+
+    bool next(int, render_tile &tile) override // every thread takes the next line, the index doesn't matter
+    {
+        int j = next_line.fetch_add(1, std::memory_order_relaxed);
+        if (j >= height)
+            return false;
+        tile = {0, j, width, j + 1};
+        return true;
+    }
+
+    int size() const override { return height; }
+
+private:
+    int width, height;
+    std::atomic<int> next_line{0};
+};
+
+// Splits the image into tiles, sorts them along a space filling curve and deals every thread a consecutive run of
+// them. A thread works through its own queue from the front; when it runs dry it steals from the back of the other
+// queues, so expensive tiles at the end don't leave the other threads idle.
+class tile_scheduler : public render_scheduler
+{
+public:
+    // tile widths are rounded up to 16 pixels: the image lines are padded to that, so tiles side by side never share a
+    // cache line in any plane of the image (see parallel.hh)
+    tile_scheduler(int width, int height, int tile_size, tile_order order, int thread_count)
+        : queue_count(thread_count > 0 ? thread_count : 1), queues(new tile_queue[queue_count])
+    {
+        int tile_width = std::max(16, (tile_size + 15) / 16 * 16);
+        int tile_height = std::max(1, tile_size);
+        int tiles_x = (width + tile_width - 1) / tile_width;
+        int tiles_y = (height + tile_height - 1) / tile_height;
+
+        struct keyed_tile
+        {
+            uint64_t key;
+            render_tile tile;
+        };
+        std::vector<keyed_tile> tiles;
+        tiles.reserve(tiles_x * tiles_y);
+        for (int ty = 0; ty < tiles_y; ty++)
+        {
+            for (int tx = 0; tx < tiles_x; tx++)
+            {
+                render_tile tile = {tx * tile_width, ty * tile_height,
+                                    std::min(width, (tx + 1) * tile_width), std::min(height, (ty + 1) * tile_height)};
+                uint64_t key = order == tile_order::morton ? morton_key(tx, ty) : spiral_key(tx, ty, tiles_x, tiles_y);
+                tiles.push_back({key, tile});
+            }
+        }
+        std::stable_sort(tiles.begin(), tiles.end(), [](const keyed_tile &a, const keyed_tile &b)
+                         { return a.key < b.key; });
+
+        tile_count = static_cast<int>(tiles.size());
+        for (int q = 0; q < queue_count; q++)
+        {
+            size_t first = tiles.size() * q / queue_count;
+            size_t last = tiles.size() * (q + 1) / queue_count;
+            for (size_t i = first; i < last; i++)
+                queues[q].tiles.push_back(tiles[i].tile);
+        }
+    }
+
+    bool next(int thread_index, render_tile &tile) override
+    {
+        int own = thread_index % queue_count;
+        if (queues[own].pop_front(tile))
+            return true;
+
+        // own queue is empty: steal from the others, no new tiles are ever added so empty queues stay empty
+        for (int k = 1; k < queue_count; k++)
+        {
+            if (queues[(own + k) % queue_count].pop_back(tile))
+                return true;
+        }
+        return false;
+    }
+
+    int size() const override { return tile_count; }
+
+private:
+    // the owner takes tiles from the front and thieves from the back, so they rarely want the same lock at once
+    struct alignas(64) tile_queue
+    {
+        std::mutex lock;
+        std::deque<render_tile> tiles;
+
+        bool pop_front(render_tile &tile)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tiles.empty())
+                return false;
+            tile = tiles.front();
+            tiles.pop_front();
+            return true;
+        }
+
+        bool pop_back(render_tile &tile)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tiles.empty())
+                return false;
+            tile = tiles.back();
+            tiles.pop_back();
+            return true;
+        }
+    };
+
+    int queue_count;
+    std::unique_ptr<tile_queue[]> queues;
+    int tile_count = 0;
+
+    // interleaves the bits of x and y
+    static uint64_t morton_key(uint32_t x, uint32_t y)
+    {
+        uint64_t key = 0;
+        for (int bit = 0; bit < 32; bit++)
+        {
+            key |= static_cast<uint64_t>((x >> bit) & 1) << (2 * bit);
+            key |= static_cast<uint64_t>((y >> bit) & 1) << (2 * bit + 1);
+        }
+        return key;
+    }
+
+    // orders tiles by the square ring around the center they lie on, then by angle within the ring
+    static uint64_t spiral_key(int x, int y, int tiles_x, int tiles_y)
+    {
+        double dx = x - (tiles_x - 1) / 2.0;
+        double dy = y - (tiles_y - 1) / 2.0;
+        auto ring = static_cast<uint64_t>(std::ceil(std::max(std::fabs(dx), std::fabs(dy))));
+        double angle = std::atan2(dy, dx) + 3.14159265358979323846; // [0, 2pi]
+        auto step = static_cast<uint64_t>(angle * 1000000);
+        return (ring << 32) | step;
+    }
+};
+
+#endif
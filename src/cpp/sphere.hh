@@ -4,15 +4,45 @@
 #include "hittable.hh"
 #include "vec3.hh"
 
-class sphere : public hittable
+#include <limits>
+
+// Rounding errors of a hit point on a sphere grow with the largest numbers the intersection works with: the distance
+// of the center from the origin plus the radius. Hit points are projected back onto the sphere, which keeps the error
+// within a few machine epsilons of that scale no matter how far the ray came, so scattered rays start this far off
+// the surface (see basic_hit_record::spawn_ray).
+template <typename T>
+inline T sphere_hit_error(const basic_point3<T> &center, T radius)
+{
+    constexpr T error_ulps = 8;
+    return error_ulps * std::numeric_limits<T>::epsilon() * (max_abs_component(center) + radius);
+}
+
+// fills rec for a hit of the sphere at distance t
+template <typename T>
+inline void set_sphere_hit(const basic_ray<T> &r, T t, const basic_point3<T> &center, T radius, basic_hit_record<T> &rec)
+{
+    rec.t = t;
+    basic_vec3<T> from_center = r.at(t) - center;
+    T distance = from_center.length();
+    rec.p = center + from_center * (radius / distance); // back onto the surface
+    rec.set_face_normal(r, from_center / distance);
+    rec.spawn_offset = sphere_hit_error(center, radius);
+}
+
+template <typename T>
+class basic_sphere : public basic_hittable<T>
 {
 public:
-    sphere(point3 _center, double _radius, shared_ptr<material> _material)
-        : center(_center), radius(_radius), mat(_material) {}
+    basic_sphere(basic_point3<T> _center, T _radius, const basic_material<T> *_material)
+        : center(_center), radius(_radius), mat(_material)
+    {
+        auto rvec = basic_vec3<T>(radius, radius, radius);
+        bbox = basic_aabb<T>(center - rvec, center + rvec);
+    }
 
-    bool hit(const ray &r, interval ray_t, hit_record &rec) const override
+    bool hit(const basic_ray<T> &r, basic_interval<T> ray_t, basic_hit_record<T> &rec) const override
     {
-        vec3 oc = r.origin() - center; // vector from center of sphere to ray origin
+        basic_vec3<T> oc = r.origin() - center; // vector from center of sphere to ray origin
 
         // t^2*v⋅v  +  2tv⋅(A−C)  +  (A−C)⋅(A−C)−r2 = 0
         // a = v⋅v   b = 2v⋅(A-C)    c = (A-C)⋅(A-C)-r2
@@ -36,19 +66,25 @@ public:
         }
 
         // update the hit record of this object
-        rec.t = root;
-        rec.p = r.at(rec.t);
-        vec3 outward_normal = (rec.p - center) / radius;
-        rec.set_face_normal(r, outward_normal);
+        set_sphere_hit(r, root, center, radius, rec);
         rec.mat = mat;
 
         return true;
     }
 
+    basic_aabb<T> bounding_box() const override { return bbox; }
+
+    basic_point3<T> center_point() const { return center; }
+    T radius_length() const { return radius; }
+    const basic_material<T> *material_ptr() const { return mat; }
+
 private:
-    point3 center;
-    double radius;
-    shared_ptr<material> mat;
+    basic_point3<T> center;
+    T radius;
+    const basic_material<T> *mat; // owned by the material table of the scene
+    basic_aabb<T> bbox;
 };
 
-#endif
\ No newline at end of file
+using sphere = basic_sphere<double>;
+
+#endif
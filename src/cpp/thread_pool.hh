@@ -0,0 +1,142 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that is kept alive between renders. Idle workers sleep on a condition variable,
+// run() wakes all of them up for one job and returns once every worker is done with it.
+class thread_pool
+{
+public:
+    thread_pool(int thread_count = 0)
+    {
+        resize(thread_count);
+    }
+
+    ~thread_pool()
+    {
+        resize(0);
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    int size() const
+    {
+        return static_cast<int>(workers.size());
+    }
+
+    // starts or stops workers until there are thread_count of them, waits for a running job first
+    void resize(int thread_count)
+    {
+        std::lock_guard<std::mutex> run_guard(lock_run);
+        if (thread_count < 0)
+            thread_count = 0;
+        if (thread_count == size())
+            return;
+
+        if (thread_count < size())
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                worker_limit = thread_count; // workers with a higher index leave their loop
+            }
+            wake.notify_all();
+            for (int i = thread_count; i < size(); i++)
+                workers[i].join();
+            workers.resize(thread_count);
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        worker_limit = thread_count;
+        for (int i = size(); i < thread_count; i++)
+            workers.emplace_back(&thread_pool::work, this, i, generation);
+    }
+
+    // calls job(thread_index) once on every worker and blocks until all calls have returned
+    void run(const std::function<void(int)> &job)
+    {
+        std::lock_guard<std::mutex> run_guard(lock_run);
+        std::unique_lock<std::mutex> guard(lock);
+        current_job = &job;
+        pending = size();
+        generation++;
+        wake.notify_all();
+        done.wait(guard, [this]
+                  { return pending == 0; });
+        current_job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex lock_run; // one job or resize at a time
+    std::mutex lock;     // protects everything below
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)> *current_job = nullptr;
+    uint64_t generation = 0; // increases with every job, tells a worker that there is new work
+    int pending = 0;         // workers that have not finished the current job
+    int worker_limit = 0;
+
+    void work(int index, uint64_t seen_generation)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true)
+        {
+            wake.wait(guard, [&]
+                      { return index >= worker_limit || generation != seen_generation; });
+            if (index >= worker_limit)
+                return;
+
+            seen_generation = generation;
+            const auto *job = current_job;
+            guard.unlock();
+            (*job)(index);
+            guard.lock();
+
+            if (--pending == 0)
+                done.notify_all();
+        }
+    }
+};
+
+// runs convert_line(j, worker) for every line of an image, on all workers of the pool if there is one. worker is the
+// index of the worker that converts the line, below line_workers(pool), for scratch memory of every worker.
+template <typename ConvertLine>
+void for_each_line_of_worker(int height, thread_pool *pool, ConvertLine convert_line)
+{
+    int thread_count = pool ? pool->size() : 0;
+    if (thread_count <= 1)
+    {
+        for (int j = 0; j < height; j++)
+            convert_line(j, 0);
+        return;
+    }
+    pool->run([&](int thread_index)
+              {
+        for (int j = thread_index; j < height; j += thread_count)
+            convert_line(j, thread_index); });
+}
+
+// the number of workers for_each_line_of_worker converts lines on
+inline int line_workers(thread_pool *pool)
+{
+    return pool && pool->size() > 1 ? pool->size() : 1;
+}
+
+// runs convert_line(j) for every line of an image, on all workers of the pool if there is one
+template <typename ConvertLine>
+void for_each_line(int height, thread_pool *pool, ConvertLine convert_line)
+{
+    for_each_line_of_worker(height, pool, [&](int j, int)
+                            { convert_line(j); });
+}
+
+#endif
@@ -1,31 +1,41 @@
 #ifndef VEC3_HH
 #define VEC3_HH
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include "rtweekend.hh"
 
 using std::sqrt;
-class vec3
+
+// T is the scalar type of the components, double by default and float for single precision renders
+template <typename T>
+class basic_vec3
 {
 public:
-    double e[3];
+    using value_type = T;
+
+    T e[3];
 
     // define coordinates using initializer list
-    vec3() : e{0, 0, 0} {}
-    vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+    basic_vec3() : e{0, 0, 0} {}
+    basic_vec3(T e0, T e1, T e2) : e{e0, e1, e2} {}
+
+    // converts between precisions
+    template <typename U>
+    explicit basic_vec3(const basic_vec3<U> &v) : e{static_cast<T>(v.e[0]), static_cast<T>(v.e[1]), static_cast<T>(v.e[2])} {}
 
     // getters for coordinates
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
     // implement operators
-    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-    double operator[](int i) const { return e[i]; }
-    double &operator[](int i) { return e[i]; } // access modifiably
+    basic_vec3 operator-() const { return basic_vec3(-e[0], -e[1], -e[2]); }
+    T operator[](int i) const { return e[i]; }
+    T &operator[](int i) { return e[i]; } // access modifiably
 
-    vec3 &operator+=(const vec3 &v)
+    basic_vec3 &operator+=(const basic_vec3 &v)
     {
         e[0] += v[0];
         e[1] += v[1];
@@ -33,7 +43,7 @@ public:
         return *this;
     }
 
-    vec3 &operator*=(const double t)
+    basic_vec3 &operator*=(const T t)
     {
         e[0] *= t;
         e[1] *= t;
@@ -41,139 +51,220 @@ public:
         return *this;
     }
 
-    vec3 &operator/=(double t)
+    basic_vec3 &operator/=(T t)
     {
         return *this *= 1 / t;
     }
 
-    double length_squared() const
+    T length_squared() const
     {
         return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
     }
 
-    double length() const
+    T length() const
     {
         return sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
     }
 
-    static vec3 random()
+    // the random numbers are drawn in double precision, so both precisions see the same sequence
+    static basic_vec3 random(rng &gen)
     {
-        return vec3(random_double(), random_double(), random_double());
+        return basic_vec3(random_double(gen), random_double(gen), random_double(gen));
     }
 
-    static vec3 random(double min, double max)
+    static basic_vec3 random(rng &gen, double min, double max)
     {
-        return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+        return basic_vec3(random_double(gen, min, max), random_double(gen, min, max), random_double(gen, min, max));
     }
 
     bool near_zero() const
     {
         auto s = 1e-8;
-        return (fabs(e[0] < s) && (fabs(e[2]) < s));
+        return fabs(e[0]) < s && fabs(e[1]) < s && fabs(e[2]) < s;
     }
 };
 
+// scalar arguments next to a vector don't take part in template argument deduction, so 2 * v or v / 2.0 work for
+// vectors of either precision
+template <typename T>
+using scalar_of = typename basic_vec3<T>::value_type;
+
+template <typename T>
+using basic_point3 = basic_vec3<T>;
+
+using vec3 = basic_vec3<double>;
 using point3 = vec3; // 3D point
 
 // Vector Utility Functions
 
-inline std::ostream &operator<<(std::ostream &out, const vec3 &v)
+template <typename T>
+inline std::ostream &operator<<(std::ostream &out, const basic_vec3<T> &v)
 {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3 &u, const vec3 &v)
+template <typename T>
+inline basic_vec3<T> operator+(const basic_vec3<T> &u, const basic_vec3<T> &v)
 {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+    return basic_vec3<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v)
+template <typename T>
+inline basic_vec3<T> operator-(const basic_vec3<T> &u, const basic_vec3<T> &v)
 {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+    return basic_vec3<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
-inline vec3 operator*(const vec3 &u, const vec3 &v)
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T> &u, const basic_vec3<T> &v)
 {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+    return basic_vec3<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3 &v)
+template <typename T>
+inline basic_vec3<T> operator*(scalar_of<T> t, const basic_vec3<T> &v)
 {
-    return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+    return basic_vec3<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
-inline vec3 operator*(const vec3 &v, double t)
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T> &v, scalar_of<T> t)
 {
     return t * v;
 }
 
-inline vec3 operator/(vec3 v, double t)
+template <typename T>
+inline basic_vec3<T> operator/(basic_vec3<T> v, scalar_of<T> t)
 {
     return (1 / t) * v;
 }
 
-inline double dot(const vec3 &u, const vec3 &v)
+// std::max/min instead of fmax/fmin in the hot helpers: those are calls into libm, which cost an sse/avx transition
+// each in builds for avx. They only differ for NaN.
+template <typename T>
+inline T max_component(const basic_vec3<T> &v)
+{
+    return std::max(v.x(), std::max(v.y(), v.z()));
+}
+
+// largest absolute coordinate, the scale that rounding errors of a point grow with
+template <typename T>
+inline T max_abs_component(const basic_vec3<T> &v)
+{
+    return std::max(std::fabs(v.x()), std::max(std::fabs(v.y()), std::fabs(v.z())));
+}
+
+template <typename T>
+inline T dot(const basic_vec3<T> &u, const basic_vec3<T> &v)
 {
     return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
 }
 
-inline vec3 cross(const vec3 &u, const vec3 &v)
+template <typename T>
+inline basic_vec3<T> cross(const basic_vec3<T> &u, const basic_vec3<T> &v)
 {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    return basic_vec3<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                         u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                         u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(vec3 v)
+template <typename T>
+inline basic_vec3<T> unit_vector(basic_vec3<T> v)
 {
     return v / v.length();
 }
 
-inline vec3 random_in_unit_sphere()
+template <typename T = double>
+inline basic_vec3<T> random_in_unit_sphere(rng &gen)
 {
     while (true)
     {
-        auto p = vec3::random(-1, 1);
+        auto p = basic_vec3<T>::random(gen, -1, 1);
         if (p.length_squared() < 1)
             return p;
     }
 }
 
-inline vec3 random_in_unit_disk()
+template <typename T = double>
+inline basic_vec3<T> random_in_unit_disk(rng &gen)
 {
     while (true)
     {
-        auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
+        auto p = basic_vec3<T>(random_double(gen, -1, 1), random_double(gen, -1, 1), 0);
         if (p.length_squared() < 1)
             return p;
     }
 }
 
-inline vec3 random_unit_vector()
+template <typename T = double>
+inline basic_vec3<T> random_unit_vector(rng &gen)
+{
+    return unit_vector(random_in_unit_sphere<T>(gen));
+}
+
+// The two below map numbers in [0, 1) to a shape without rejection, so numbers that are spread evenly over the square
+// (see sampler.hh) stay spread evenly over the shape.
+
+// uniform on the unit sphere: z uniform in [-1, 1] and a uniform angle around z
+template <typename T = double>
+inline basic_vec3<T> unit_vector_from(double u, double v)
+{
+    T z = static_cast<T>(1 - 2 * u);
+    T r = std::sqrt(std::max(T(0), 1 - z * z));
+    T phi = static_cast<T>(2 * pi * v);
+    return basic_vec3<T>(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// uniform in the unit disk, concentric map of the square (Shirley and Chiu 1997) so neighbours stay neighbours
+template <typename T = double>
+inline basic_vec3<T> in_unit_disk_from(double u, double v)
 {
-    return unit_vector(random_in_unit_sphere());
+    T a = static_cast<T>(2 * u - 1);
+    T b = static_cast<T>(2 * v - 1);
+    if (a == 0 && b == 0)
+        return basic_vec3<T>(0, 0, 0);
+    T r, phi;
+    if (std::abs(a) > std::abs(b))
+    {
+        r = a;
+        phi = static_cast<T>(pi / 4) * (b / a);
+    }
+    else
+    {
+        r = b;
+        phi = static_cast<T>(pi / 2) - static_cast<T>(pi / 4) * (a / b);
+    }
+    return basic_vec3<T>(r * std::cos(phi), r * std::sin(phi), 0);
 }
 
-inline vec3 random_on_hemisphere(const vec3 &normal)
+template <typename T>
+inline basic_vec3<T> random_on_hemisphere(const basic_vec3<T> &normal, rng &gen)
 {
-    vec3 on_unit_sphere = random_unit_vector();
-    if (dot(on_unit_sphere, normal) > 0.0)
+    basic_vec3<T> on_unit_sphere = random_unit_vector<T>(gen);
+    if (dot(on_unit_sphere, normal) > 0)
         return on_unit_sphere;
     else
         return -on_unit_sphere;
 }
 
-inline vec3 reflect(const vec3 &v, const vec3 &n)
+template <typename T>
+inline basic_vec3<T> reflect(const basic_vec3<T> &v, const basic_vec3<T> &n)
 {
     return (v - 2 * dot(v, n) * n); // formular for simple reflection against a normal vector
 }
 
-inline vec3 refract(const vec3 &uv, const vec3 &n, double etai_over_etat)
+template <typename T>
+inline basic_vec3<T> refract(const basic_vec3<T> &uv, const basic_vec3<T> &n, scalar_of<T> etai_over_etat)
 {
-    auto cos_theta = fmin(dot(-uv, n), 1.0);
-    vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+    T cos_theta = std::min(dot(-uv, n), T(1));
+    basic_vec3<T> r_out_perp = etai_over_etat * (uv + cos_theta * n);
+    basic_vec3<T> r_out_parallel = -sqrt(std::fabs(1 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 
+// compile time switch to vec3 stored in simd registers
+#if defined(RAYTRACER_SIMD_VEC3)
+#include "vec3_simd.hh"
+#endif
+
 #endif
\ No newline at end of file
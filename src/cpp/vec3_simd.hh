@@ -0,0 +1,241 @@
+#ifndef VEC3_SIMD_HH
+#define VEC3_SIMD_HH
+
+// Alternative vec3 for builds with RAYTRACER_SIMD_VEC3: the three components live in one padded simd register, x, y, z
+// and a fourth lane that only ever holds zero (or its sign). Doubles take an avx register and need AVX2 for the lane
+// shuffles of cross, floats an sse register. The API is the one of the scalar basic_vec3, only the storage and the
+// operators below differ. Every operation adds up in the same order as the scalar code, so both give the same results
+// as long as the compiler doesn't fuse the scalar code into fma (the build passes -ffp-contract=off).
+
+#include "vec3.hh"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VEC3_SIMD_DOUBLE 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VEC3_SIMD_FLOAT 1
+#endif
+
+#if defined(VEC3_SIMD_DOUBLE)
+template <>
+class alignas(32) basic_vec3<double>
+{
+public:
+    using value_type = double;
+
+    union
+    {
+        __m256d v;   // x, y, z, 0
+        double e[4]; // same lanes one by one
+    };
+
+    basic_vec3() : v(_mm256_setzero_pd()) {}
+    basic_vec3(double e0, double e1, double e2) : v(_mm256_set_pd(0, e2, e1, e0)) {}
+    explicit basic_vec3(__m256d lanes) : v(lanes) {}
+
+    template <typename U>
+    explicit basic_vec3(const basic_vec3<U> &other)
+        : basic_vec3(static_cast<double>(other.x()), static_cast<double>(other.y()), static_cast<double>(other.z())) {}
+
+    double x() const { return e[0]; }
+    double y() const { return e[1]; }
+    double z() const { return e[2]; }
+
+    basic_vec3 operator-() const { return basic_vec3(_mm256_xor_pd(v, _mm256_set1_pd(-0.0))); }
+    double operator[](int i) const { return e[i]; }
+    double &operator[](int i) { return e[i]; }
+
+    basic_vec3 &operator+=(const basic_vec3 &other)
+    {
+        v = _mm256_add_pd(v, other.v);
+        return *this;
+    }
+
+    basic_vec3 &operator*=(const double t)
+    {
+        v = _mm256_mul_pd(v, _mm256_set1_pd(t));
+        return *this;
+    }
+
+    basic_vec3 &operator/=(double t)
+    {
+        return *this *= 1 / t;
+    }
+
+    double length_squared() const
+    {
+        return sum_xyz(_mm256_mul_pd(v, v));
+    }
+
+    double length() const
+    {
+        return sqrt(length_squared());
+    }
+
+    static basic_vec3 random(rng &gen)
+    {
+        return basic_vec3(random_double(gen), random_double(gen), random_double(gen));
+    }
+
+    static basic_vec3 random(rng &gen, double min, double max)
+    {
+        return basic_vec3(random_double(gen, min, max), random_double(gen, min, max), random_double(gen, min, max));
+    }
+
+    bool near_zero() const
+    {
+        auto s = 1e-8;
+        return fabs(e[0]) < s && fabs(e[1]) < s && fabs(e[2]) < s;
+    }
+
+    // (x + y) + z of the lanes, the padding lane is left out
+    static double sum_xyz(__m256d lanes)
+    {
+        __m128d xy = _mm256_castpd256_pd128(lanes);
+        __m128d zw = _mm256_extractf128_pd(lanes, 1);
+        __m128d sum = _mm_add_sd(xy, _mm_unpackhi_pd(xy, xy));
+        return _mm_cvtsd_f64(_mm_add_sd(sum, zw));
+    }
+};
+
+inline vec3 operator+(const vec3 &u, const vec3 &v) { return vec3(_mm256_add_pd(u.v, v.v)); }
+inline vec3 operator-(const vec3 &u, const vec3 &v) { return vec3(_mm256_sub_pd(u.v, v.v)); }
+inline vec3 operator*(const vec3 &u, const vec3 &v) { return vec3(_mm256_mul_pd(u.v, v.v)); }
+inline vec3 operator*(double t, const vec3 &v) { return vec3(_mm256_mul_pd(_mm256_set1_pd(t), v.v)); }
+inline vec3 operator*(const vec3 &v, double t) { return t * v; }
+inline vec3 operator/(vec3 v, double t) { return (1 / t) * v; }
+
+inline double dot(const vec3 &u, const vec3 &v)
+{
+    return vec3::sum_xyz(_mm256_mul_pd(u.v, v.v));
+}
+
+inline vec3 cross(const vec3 &u, const vec3 &v)
+{
+    // (y, z, x) * (z, x, y) - (z, x, y) * (y, z, x)
+    __m256d u_yzx = _mm256_permute4x64_pd(u.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256d u_zxy = _mm256_permute4x64_pd(u.v, _MM_SHUFFLE(3, 1, 0, 2));
+    __m256d v_yzx = _mm256_permute4x64_pd(v.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256d v_zxy = _mm256_permute4x64_pd(v.v, _MM_SHUFFLE(3, 1, 0, 2));
+    return vec3(_mm256_sub_pd(_mm256_mul_pd(u_yzx, v_zxy), _mm256_mul_pd(u_zxy, v_yzx)));
+}
+
+inline vec3 unit_vector(vec3 v)
+{
+    return vec3(_mm256_mul_pd(_mm256_set1_pd(1 / v.length()), v.v));
+}
+#endif
+
+#if defined(VEC3_SIMD_FLOAT)
+template <>
+class alignas(16) basic_vec3<float>
+{
+public:
+    using value_type = float;
+
+    union
+    {
+        __m128 v;   // x, y, z, 0
+        float e[4]; // same lanes one by one
+    };
+
+    basic_vec3() : v(_mm_setzero_ps()) {}
+    basic_vec3(float e0, float e1, float e2) : v(_mm_set_ps(0, e2, e1, e0)) {}
+    explicit basic_vec3(__m128 lanes) : v(lanes) {}
+
+    template <typename U>
+    explicit basic_vec3(const basic_vec3<U> &other)
+        : basic_vec3(static_cast<float>(other.x()), static_cast<float>(other.y()), static_cast<float>(other.z())) {}
+
+    float x() const { return e[0]; }
+    float y() const { return e[1]; }
+    float z() const { return e[2]; }
+
+    basic_vec3 operator-() const { return basic_vec3(_mm_xor_ps(v, _mm_set1_ps(-0.0f))); }
+    float operator[](int i) const { return e[i]; }
+    float &operator[](int i) { return e[i]; }
+
+    basic_vec3 &operator+=(const basic_vec3 &other)
+    {
+        v = _mm_add_ps(v, other.v);
+        return *this;
+    }
+
+    basic_vec3 &operator*=(const float t)
+    {
+        v = _mm_mul_ps(v, _mm_set1_ps(t));
+        return *this;
+    }
+
+    basic_vec3 &operator/=(float t)
+    {
+        return *this *= 1 / t;
+    }
+
+    float length_squared() const
+    {
+        return sum_xyz(_mm_mul_ps(v, v));
+    }
+
+    float length() const
+    {
+        return sqrt(length_squared());
+    }
+
+    static basic_vec3 random(rng &gen)
+    {
+        return basic_vec3(random_double(gen), random_double(gen), random_double(gen));
+    }
+
+    static basic_vec3 random(rng &gen, double min, double max)
+    {
+        return basic_vec3(random_double(gen, min, max), random_double(gen, min, max), random_double(gen, min, max));
+    }
+
+    bool near_zero() const
+    {
+        auto s = 1e-8;
+        return fabs(e[0]) < s && fabs(e[1]) < s && fabs(e[2]) < s;
+    }
+
+    // (x + y) + z of the lanes, the padding lane is left out
+    static float sum_xyz(__m128 lanes)
+    {
+        __m128 sum = _mm_add_ss(lanes, _mm_shuffle_ps(lanes, lanes, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(_mm_add_ss(sum, _mm_movehl_ps(lanes, lanes)));
+    }
+};
+
+using vec3f = basic_vec3<float>;
+
+inline vec3f operator+(const vec3f &u, const vec3f &v) { return vec3f(_mm_add_ps(u.v, v.v)); }
+inline vec3f operator-(const vec3f &u, const vec3f &v) { return vec3f(_mm_sub_ps(u.v, v.v)); }
+inline vec3f operator*(const vec3f &u, const vec3f &v) { return vec3f(_mm_mul_ps(u.v, v.v)); }
+inline vec3f operator*(float t, const vec3f &v) { return vec3f(_mm_mul_ps(_mm_set1_ps(t), v.v)); }
+inline vec3f operator*(const vec3f &v, float t) { return t * v; }
+inline vec3f operator/(vec3f v, float t) { return (1 / t) * v; }
+
+inline float dot(const vec3f &u, const vec3f &v)
+{
+    return vec3f::sum_xyz(_mm_mul_ps(u.v, v.v));
+}
+
+inline vec3f cross(const vec3f &u, const vec3f &v)
+{
+    // (y, z, x) * (z, x, y) - (z, x, y) * (y, z, x)
+    __m128 u_yzx = _mm_shuffle_ps(u.v, u.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 u_zxy = _mm_shuffle_ps(u.v, u.v, _MM_SHUFFLE(3, 1, 0, 2));
+    __m128 v_yzx = _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 v_zxy = _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(3, 1, 0, 2));
+    return vec3f(_mm_sub_ps(_mm_mul_ps(u_yzx, v_zxy), _mm_mul_ps(u_zxy, v_yzx)));
+}
+
+inline vec3f unit_vector(vec3f v)
+{
+    return vec3f(_mm_mul_ps(_mm_set1_ps(1 / v.length()), v.v));
+}
+#endif
+
+#endif
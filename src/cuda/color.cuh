@@ -4,6 +4,7 @@
 #include "vec3.cuh"
 
 #include <fstream>
+#include <vector>
 
 inline float linear_to_gamma(float linear_component)
 {
@@ -19,16 +20,11 @@ float clamp(double x)
     return x;
 }
 
+// writes the frame buffer as binary ppm (P6), the frame buffer is stored bottom up
 void write_color(vec3 *image, int image_width, int image_height)
 {
-    std::ofstream out("out.ppm");
-    // write ppm header
-    out.write("P3\n", 3);
-    out.write(std::to_string(image_width).c_str(), std::to_string(image_width).length());
-    out.write(" ", 1);
-    out.write(std::to_string(image_height).c_str(), std::to_string(image_height).length());
-    out.write("\n", 1);
-    out.write("255\n", 4);
+    std::vector<unsigned char> rgb;
+    rgb.reserve(3 * static_cast<size_t>(image_width) * image_height);
 
     for (int j = image_height - 1; j >= 0; j--)
     {
@@ -42,11 +38,15 @@ void write_color(vec3 *image, int image_width, int image_height)
             auto b = linear_to_gamma(pixel_color.z());
 
             // Write the translated [0,255] value of each color component.
-            out << static_cast<int>(256 * clamp(r)) << ' '
-                << static_cast<int>(256 * clamp(g)) << ' '
-                << static_cast<int>(256 * clamp(b)) << '\n';
+            rgb.push_back(static_cast<unsigned char>(256 * clamp(r)));
+            rgb.push_back(static_cast<unsigned char>(256 * clamp(g)));
+            rgb.push_back(static_cast<unsigned char>(256 * clamp(b)));
         }
     }
+
+    std::ofstream out("out.ppm", std::ios::binary);
+    out << "P6\n" << image_width << " " << image_height << "\n255\n";
+    out.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
     out.close();
 }
 #endif
\ No newline at end of file
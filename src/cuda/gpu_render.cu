@@ -9,6 +9,7 @@
 #include "color.cuh"
 
 #include <iostream>
+#include <vector>
 #include <time.h>
 #include <float.h>
 #include <curand_kernel.h>
@@ -28,21 +29,33 @@ void check_cuda(cudaError_t result, char const *const func, const char *const fi
     }
 }
 
-__device__ vec3 color(const ray &r, hittable **world, curandState *local_rand_state, int max_depth)
+// with russian roulette, paths past roulette_min_depth continue with a probability matching their throughput
+__device__ vec3 color(const ray &r, hittable **world, curandState *local_rand_state, int max_depth, bool russian_roulette,
+                      int roulette_min_depth)
 {
     ray cur_ray = r;
     vec3 cur_attenuation = vec3(1.0, 1.0, 1.0);
+    vec3 throughput = vec3(1.0, 1.0, 1.0); // like cur_attenuation but without the roulette weights
+    const hittable_list *scene = static_cast<const hittable_list *>(*world); // create_world always builds a list
     for (int i = 0; i < max_depth; i++)
     {
         hit_record rec;
-        if ((*world)->hit(cur_ray, 0.001f, FLT_MAX, rec))
+        if (scene->hittable_list::hit(cur_ray, 0.001f, FLT_MAX, rec))
         {
             ray scattered;
             vec3 attenuation;
-            if (rec.mat_ptr->scatter(cur_ray, rec, attenuation, scattered, local_rand_state))
+            if (scatter(rec.mat_ptr, cur_ray, rec, attenuation, scattered, local_rand_state))
             {
                 cur_attenuation *= attenuation;
+                throughput *= attenuation;
                 cur_ray = scattered;
+                if (russian_roulette && i >= roulette_min_depth)
+                {
+                    float survival = fminf(1.0f, fmaxf(0.05f, fmaxf(throughput.x(), fmaxf(throughput.y(), throughput.z()))));
+                    if (curand_uniform(local_rand_state) > survival)
+                        return vec3(0.0, 0.0, 0.0);
+                    cur_attenuation /= survival;
+                }
             }
             else
             {
@@ -78,7 +91,8 @@ __global__ void render_init(int max_x, int max_y, curandState *rand_state)
     curand_init(1984, pixel_index, 0, &rand_state[pixel_index]);
 }
 
-__global__ void render(vec3 *fb, int max_x, int max_y, int ns, camera **cam, hittable **world, curandState *rand_state, int max_depth)
+__global__ void render(vec3 *fb, int max_x, int max_y, int ns, camera **cam, hittable **world, curandState *rand_state, int max_depth,
+                       bool russian_roulette, int roulette_min_depth)
 {
     int i = threadIdx.x + blockIdx.x * blockDim.x;
     int j = threadIdx.y + blockIdx.y * blockDim.y;
@@ -94,7 +108,7 @@ __global__ void render(vec3 *fb, int max_x, int max_y, int ns, camera **cam, hit
         float u = float(i + curand_uniform(&local_rand_state)) / float(max_x);
         float v = float(j + curand_uniform(&local_rand_state)) / float(max_y);
         ray r = (*cam)->get_ray(u, v, &local_rand_state);
-        col += color(r, world, &local_rand_state, max_depth);
+        col += color(r, world, &local_rand_state, max_depth, russian_roulette, roulette_min_depth);
     }
 
     rand_state[pixel_index] = local_rand_state;
@@ -168,7 +182,33 @@ __global__ void free_world(hittable **d_list, hittable **d_world, camera **d_cam
     delete *d_camera;
 }
 
-void gpu_render(int ny, float aspect_ratio, int ns, int max_depth, point _camera_pos, point _focal_point, float vfov, float aperture, double &last_render_time)
+// converts the gamma corrected frame buffer (bottom line first, in managed memory) to the rgba of the snapshot
+void publish_snapshot(const vec3 *fb, int nx, int ny, int ns, render_snapshot &snapshot)
+{
+    std::vector<uint8_t> rgba(4 * static_cast<size_t>(nx) * ny);
+    for (int j = 0; j < ny; j++)
+    {
+        const vec3 *source = fb + static_cast<size_t>(ny - 1 - j) * nx;
+        uint8_t *line = &rgba[4 * static_cast<size_t>(j) * nx];
+        for (int i = 0; i < nx; i++)
+        {
+            line[4 * i + 0] = static_cast<uint8_t>(256 * clamp(source[i].x()));
+            line[4 * i + 1] = static_cast<uint8_t>(256 * clamp(source[i].y()));
+            line[4 * i + 2] = static_cast<uint8_t>(256 * clamp(source[i].z()));
+            line[4 * i + 3] = 255;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(snapshot.lock);
+    snapshot.rgba.swap(rgba);
+    snapshot.width = nx;
+    snapshot.height = ny;
+    snapshot.samples = ns;
+    snapshot.version.fetch_add(1, std::memory_order_release);
+}
+
+void gpu_render(int ny, float aspect_ratio, int ns, int max_depth, point _camera_pos, point _focal_point, float vfov, float aperture, double &last_render_time,
+                bool russian_roulette, int roulette_min_depth, render_snapshot *snapshot)
 {
     vec3 camera_pos(_camera_pos.x, _camera_pos.y, _camera_pos.z);
     vec3 focal_point(_focal_point.x, _focal_point.y, _focal_point.z);
@@ -221,7 +261,7 @@ void gpu_render(int ny, float aspect_ratio, int ns, int max_depth, point _camera
     checkCudaErrors(cudaGetLastError());
     checkCudaErrors(cudaDeviceSynchronize());
 
-    render<<<blocks, threads>>>(fb, nx, ny, ns, d_camera, d_world, d_rand_state, max_depth);
+    render<<<blocks, threads>>>(fb, nx, ny, ns, d_camera, d_world, d_rand_state, max_depth, russian_roulette, roulette_min_depth);
     checkCudaErrors(cudaGetLastError());
     checkCudaErrors(cudaDeviceSynchronize());
 
@@ -229,7 +269,10 @@ void gpu_render(int ny, float aspect_ratio, int ns, int max_depth, point _camera
     last_render_time = ((double)(stop - start)) / CLOCKS_PER_SEC;
     std::cerr << "took " << last_render_time << " seconds.\n";
 
-    write_color(fb, nx, ny);
+    if (snapshot)
+        publish_snapshot(fb, nx, ny, ns, *snapshot);
+    else
+        write_color(fb, nx, ny);
 
     // clean up
     checkCudaErrors(cudaDeviceSynchronize());
@@ -2,7 +2,11 @@
 #define GPU_RENDER_CUH
 
 #include "./point.hh"
+#include "cpp/progress.hh"
 
-void gpu_render(int ny, float aspect_ratio, int ns, int max_depth, point camera_pos, point focal_point, float vfov, float aperture, double &last_render_time);
+// russian_roulette ends dim paths at random after roulette_min_depth bounces, the image stays unbiased
+// the image is written to out.ppm, or only handed over in memory if a snapshot is given
+void gpu_render(int ny, float aspect_ratio, int ns, int max_depth, point camera_pos, point focal_point, float vfov, float aperture, double &last_render_time,
+                bool russian_roulette = false, int roulette_min_depth = 3, render_snapshot *snapshot = nullptr);
 
 #endif
\ No newline at end of file
@@ -13,10 +13,19 @@ struct hit_record
     material *mat_ptr;
 };
 
+// the built-in hittables, hittable_list dispatches on it without a virtual call
+enum class hittable_kind
+{
+    sphere,
+    custom // any other hittable, reached through the virtual hit
+};
+
 class hittable
 {
 public:
+    __device__ hittable(hittable_kind k = hittable_kind::custom) : kind(k) {}
     __device__ virtual bool hit(const ray &r, float t_min, float t_max, hit_record &rec) const = 0;
+    hittable_kind kind;
 };
 
 #endif
\ No newline at end of file
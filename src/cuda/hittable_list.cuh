@@ -2,8 +2,9 @@
 #define HITTABLELIST_CUH
 
 #include "hittable.cuh"
+#include "sphere.cuh"
 
-class hittable_list : public hittable
+class hittable_list final : public hittable
 {
 public:
     __device__ hittable_list() {}
@@ -24,7 +25,11 @@ __device__ bool hittable_list::hit(const ray &r, float t_min, float t_max, hit_r
     float closest_so_far = t_max;
     for (int i = 0; i < list_size; i++)
     {
-        if (list[i]->hit(r, t_min, closest_so_far, temp_rec))
+        // spheres are called directly, only custom hittables go through the vtable
+        bool hit_object = list[i]->kind == hittable_kind::sphere
+                              ? static_cast<const sphere *>(list[i])->sphere::hit(r, t_min, closest_so_far, temp_rec)
+                              : list[i]->hit(r, t_min, closest_so_far, temp_rec);
+        if (hit_object)
         {
             hit_anything = true;
             closest_so_far = temp_rec.t;
@@ -46,17 +46,28 @@ __device__ bool refract(const vec3 &v, const vec3 &n, float ni_over_nt, vec3 &re
         return false;
 }
 
+// the built-in materials, scatter() below dispatches on it without a virtual call
+enum class material_kind
+{
+    lambertian,
+    metal,
+    dielectric,
+    custom // any other material, reached through the virtual scatter
+};
+
 class material
 {
 public:
+    __device__ material(material_kind k = material_kind::custom) : kind(k) {}
     __device__ virtual bool scatter(
         const ray &r_in, const hit_record &rec, vec3 &attenuation, ray &scattered, curandState *local_rand_state) const = 0;
+    material_kind kind;
 };
 
-class lambertian : public material
+class lambertian final : public material
 {
 public:
-    __device__ lambertian(const vec3 &a) : albedo(a) {}
+    __device__ lambertian(const vec3 &a) : material(material_kind::lambertian), albedo(a) {}
     __device__ virtual bool scatter(const ray &r_in, const hit_record &rec, vec3 &attenuation, ray &scattered, curandState *local_rand_state) const
     {
         vec3 target = rec.p + rec.normal + random_in_unit_sphere(local_rand_state);
@@ -71,10 +82,10 @@ public:
     vec3 albedo;
 };
 
-class metal : public material
+class metal final : public material
 {
 public:
-    __device__ metal(const vec3 &a, float f) : albedo(a)
+    __device__ metal(const vec3 &a, float f) : material(material_kind::metal), albedo(a)
     {
         if (f < 1)
             fuzz = f;
@@ -92,10 +103,10 @@ public:
     float fuzz;
 };
 
-class dielectric : public material
+class dielectric final : public material
 {
 public:
-    __device__ dielectric(float index_of_refraction) : ir(index_of_refraction) {}
+    __device__ dielectric(float index_of_refraction) : material(material_kind::dielectric), ir(index_of_refraction) {}
     __device__ virtual bool scatter(const ray &r_in, const hit_record &rec, vec3 &attenuation, ray &scattered, curandState *local_rand_state) const
     {
         vec3 outward_normal;
@@ -133,4 +144,21 @@ private:
     float ir;
 };
 
+// scatters off any material: the built-in ones are called directly so nvcc can inline them, only custom materials go
+// through the vtable
+__device__ inline bool scatter(const material *mat, const ray &r_in, const hit_record &rec, vec3 &attenuation, ray &scattered, curandState *local_rand_state)
+{
+    switch (mat->kind)
+    {
+    case material_kind::lambertian:
+        return static_cast<const lambertian *>(mat)->lambertian::scatter(r_in, rec, attenuation, scattered, local_rand_state);
+    case material_kind::metal:
+        return static_cast<const metal *>(mat)->metal::scatter(r_in, rec, attenuation, scattered, local_rand_state);
+    case material_kind::dielectric:
+        return static_cast<const dielectric *>(mat)->dielectric::scatter(r_in, rec, attenuation, scattered, local_rand_state);
+    default:
+        return mat->scatter(r_in, rec, attenuation, scattered, local_rand_state);
+    }
+}
+
 #endif
\ No newline at end of file
@@ -3,11 +3,11 @@
 
 #include "hittable.cuh"
 
-class sphere : public hittable
+class sphere final : public hittable
 {
 public:
-    __device__ sphere() {}
-    __device__ sphere(vec3 cen, float r, material *m) : center(cen), radius(r), mat_ptr(m){};
+    __device__ sphere() : hittable(hittable_kind::sphere) {}
+    __device__ sphere(vec3 cen, float r, material *m) : hittable(hittable_kind::sphere), center(cen), radius(r), mat_ptr(m){};
     __device__ virtual bool hit(const ray &r, float tmin, float tmax, hit_record &rec) const;
     vec3 center;
     float radius;
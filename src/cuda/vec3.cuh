@@ -43,7 +43,7 @@ public:
     __host__ __device__ bool near_zero() const
     {
         auto s = 1e-8;
-        return (absolute(e[0]) < s) && absolute(e[1] < s) && absolute(e[2] < s);
+        return absolute(e[0]) < s && absolute(e[1]) < s && absolute(e[2]) < s;
     }
 
     float e[3];
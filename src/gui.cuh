@@ -7,7 +7,9 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
-#include <filesystem>
+#include "cpp/progress.hh"
+
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -110,64 +112,51 @@ void render()
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
-GLubyte *read_ppm(const char *filename, int *width, int *height)
+// texture the renders are shown in, created once and reused for every render
+struct render_texture
 {
-    GLubyte *texture; // The texture image
-    std::ifstream file;
-    file.open(filename, std::ios::in);
-    if (file.fail())
-    {
-        std::cerr << "Error loading the texture" << std::endl;
-    }
-    std::string skip;
-    std::getline(file, skip);
-    int texture_width, texture_height, max_value;
+    GLuint id = 0;
+    int width = 0;
+    int height = 0;
+    uint64_t version = 0; // snapshot version that was uploaded last
+    double denoise_time = 0; // of the uploaded image, 0 if it was not denoised
+};
+
+// uploads the image of the snapshot straight from memory if it changed since the last call, the texture storage is only
+// reallocated when the image size changes
+void update_render_texture(render_texture &texture, render_snapshot &snapshot)
+{
+    uint64_t version = snapshot.version.load(std::memory_order_acquire);
+    if (version == texture.version)
+        return;
 
-    file >> texture_width;
-    file >> texture_height;
-    file >> max_value;
-    texture = new GLubyte[texture_width * texture_height * 4];
+    std::lock_guard<std::mutex> guard(snapshot.lock);
+    if (snapshot.rgba.empty())
+        return;
 
-    int m, n, c;
-    for (m = texture_height - 1; m >= 0; m--)
+    if (!texture.id)
     {
-        for (n = 0; n < texture_width; n++)
-        {
-            file >> c;
-            texture[(m * texture_width + n) * 4] = (GLubyte)c;
-            file >> c;
-            texture[(m * texture_width + n) * 4 + 1] = (GLubyte)c;
-            file >> c;
-            texture[(m * texture_width + n) * 4 + 2] = (GLubyte)c;
-            texture[(m * texture_width + n) * 4 + 3] = (GLubyte)255;
-        }
+        glGenTextures(1, &texture.id);
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+
+        // Setup filtering parameters for display
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // This is required on WebGL for non power-of-two textures
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Same
     }
-    file.close();
-    return texture;
-}
-
-GLuint render_image(int width, int height)
-{
-    std::string filename = "/home/lmaag/RayTracingInOneWeekend/build-cuda/out.ppm"; // std::filesystem::current_path().string().append("/image.ppm").c_str();
-    GLubyte *image_data = read_ppm(filename.c_str(), &width, &height);
-
+    glBindTexture(GL_TEXTURE_2D, texture.id);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    // Create a OpenGL texture identifier
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    // Setup filtering parameters for display
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // This is required on WebGL for non power-of-two textures
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Same
-
-    // Upload pixels into texture
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-
-    delete[] image_data;
+    if (snapshot.width != texture.width || snapshot.height != texture.height)
+    {
+        texture.width = snapshot.width;
+        texture.height = snapshot.height;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
 
-    return texture;
+    // rows are top line first, the image is drawn with matching texture coordinates
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture.width, texture.height, GL_RGBA, GL_UNSIGNED_BYTE, snapshot.rgba.data());
+    texture.version = version;
+    texture.denoise_time = snapshot.denoise_time;
 }
@@ -1,6 +1,5 @@
 #include "gui.cuh"
-#include "cuda/gpu_render.cuh"
-#include "cpp/cpu_render.hh"
+#include "render_job.cuh"
 #include <thread>
 
 int main()
@@ -32,13 +31,18 @@ int main()
     // Our state
     ImVec4 clear_color = ImVec4(0.0f, 0.1f, 0.2f, 1.00f);
 
-    GLuint image;
+    render_job job; // renders in the background, the window keeps responding
+    render_texture image;
 
     float image_aspect_ratio = 16.0f / 9.0f;
-    double last_render_time = 0.0;
     while (!glfwWindowShouldClose(window))
     {
         handleEvents(window);
+
+        // show the newest (partial) image of the running render
+        update_render_texture(image, job.snapshot);
+        if (image.height > 0)
+            image_aspect_ratio = static_cast<float>(image.width) / image.height;
         glfwMakeContextCurrent(window);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
@@ -98,10 +102,10 @@ int main()
                 int max_x = ws.y * image_aspect_ratio;
                 int centering = (ws.x - max_x) / 2;
                 ImGui::GetWindowDrawList()->AddImage(
-                    reinterpret_cast<ImTextureID>(image),
+                    reinterpret_cast<ImTextureID>(static_cast<intptr_t>(image.id)),
                     ImVec2(pos.x + centering, pos.y),
                     ImVec2(pos.x + max_x + centering, ws.y + pos.y),
-                    ImVec2(0, 1), ImVec2(1, 0));
+                    ImVec2(0, 0), ImVec2(1, 1));
                 ImGui::End();
             }
         }
@@ -171,8 +175,13 @@ int main()
             static int depth = D10;
             const int depth_values[DEPTH_COUNT] = {1, 10, 25, 50};
 
-            static int cpu_count = std::thread::hardware_concurrency();
-            static bool render_on_device = true;
+            static int cpu_count = std::max(1u, std::thread::hardware_concurrency()); // which may report 0
+            static bool russian_roulette = false;
+            static int roulette_min_depth = 3;
+            static bool single_precision = false;
+            static bool denoise = false;
+            static int sampling = static_cast<int>(sampler_kind::owen);
+            const char *sampler_names[] = {"Independent", "Stratified", "Sobol", "Owen"};
             if (ImGui::CollapsingHeader("Render Options", ImGuiTreeNodeFlags_DefaultOpen))
             {
                 ImGui::SliderInt("Render Method", &rm, 0, OPTION_COUNT - 1, render_method_name);
@@ -180,7 +189,16 @@ int main()
                 ImGui::SliderInt("Samples per Pixel", &spp, 0, SPP_COUNT - 1, spp_name);
                 const char *depth_name = (depth >= 0 && depth < DEPTH_COUNT) ? std::to_string(depth_values[depth]).c_str() : "Unknown";
                 ImGui::SliderInt("Max Depth", &depth, 0, DEPTH_COUNT - 1, depth_name);
-                ImGui::SliderInt("CPU Cores", &cpu_count, 1, std::thread::hardware_concurrency());
+                ImGui::SliderInt("CPU Cores", &cpu_count, 1, std::max(1u, std::thread::hardware_concurrency()));
+                ImGui::Checkbox("Russian Roulette", &russian_roulette);
+                if (russian_roulette)
+                    ImGui::SliderInt("Roulette Start Depth", &roulette_min_depth, 1, 10);
+                if (!render_methods[rm])
+                {
+                    ImGui::Checkbox("Single Precision (CPU)", &single_precision);
+                    ImGui::Combo("Sampler (CPU)", &sampling, sampler_names, IM_ARRAYSIZE(sampler_names));
+                    ImGui::Checkbox("Denoise (CPU)", &denoise);
+                }
             }
 
             static int fov = 20;
@@ -196,28 +214,49 @@ int main()
             }
             ImGui::NewLine();
 
+            render_request request;
+            request.on_device = render_methods[rm];
+            request.image_height = image_heights[ih];
+            request.aspect_ratio = aspect_ratios[ar];
+            request.samples_per_pixel = spp_values[spp];
+            request.max_depth = depth_values[depth];
+            request.russian_roulette = russian_roulette;
+            request.roulette_min_depth = roulette_min_depth;
+            request.single_precision = single_precision;
+            request.sampling = static_cast<sampler_kind>(sampling);
+            request.denoise = denoise;
+            request.cpu_count = cpu_count;
+            request.cam_pos = {static_cast<float>(look_from[0]), static_cast<float>(look_from[1]), static_cast<float>(look_from[2])};
+            request.focal_point = {static_cast<float>(look_at[0]), static_cast<float>(look_at[1]), static_cast<float>(look_at[2])};
+            request.vfov = fov;
+            request.defocus_angle = defocus_angle;
+
+            // changed settings restart a running render right away
+            if (job.running() && request != job.request())
+                job.start(request);
+
             ImVec2 sz = ImVec2(ImGui::GetWindowWidth() * 0.3f, 0.0f);
-            if (ImGui::Button("Render", sz))
+            if (job.running())
             {
-                image_aspect_ratio = aspect_ratios[ar];
-                render_on_device = render_methods[rm];
-                point cam_pos = {look_from[0], look_from[1], look_from[2]};
-                point focal_point = {look_at[0], look_at[1], look_at[2]};
-
-                if (render_on_device)
-                    gpu_render(image_heights[ih], aspect_ratios[ar], spp_values[spp], depth_values[depth], cam_pos, focal_point, fov, defocus_angle, last_render_time);
+                if (ImGui::Button("Cancel", sz))
+                    job.cancel();
+                ImGui::SameLine();
+                if (request.on_device)
+                    ImGui::Text("Rendering on the GPU ...");
                 else
-                    cpu_render(image_heights[ih], aspect_ratios[ar], spp_values[spp], depth_values[depth], cam_pos, focal_point, fov, defocus_angle, cpu_count, last_render_time);
-                // void cpu_render(double _aspect_ratio, int _image_height, int _samples_per_pixel, int _max_depth, double _vfov, point _cam_pos, point _focal_point, double _aperture);
-
-                image = render_image(std::ceil(image_heights[ih] * aspect_ratios[ar]), image_heights[ih]);
+                    ImGui::ProgressBar(static_cast<float>(job.fraction()), ImVec2(-1.0f, 0.0f));
+            }
+            else if (ImGui::Button("Render", sz))
+            {
+                job.start(request);
                 show_render = true;
             }
-            if (last_render_time > 0)
+            if (job.last_render_time() > 0)
             {
                 // ImGui::SameLine();
-                ImGui::Text("Last render: %.3fs | %dx%d", last_render_time, image_heights[ih],
-                            (int)std::ceil(image_heights[ih] * aspect_ratios[ar]));
+                ImGui::Text("Last render: %.3fs | %dx%d", job.last_render_time(), image.width, image.height);
+                if (image.denoise_time > 0)
+                    ImGui::Text("Denoising: %.3fs", image.denoise_time);
             }
             ImGui::End();
         }
@@ -0,0 +1,164 @@
+#ifndef RENDER_JOB_CUH
+#define RENDER_JOB_CUH
+
+#include "cuda/gpu_render.cuh"
+#include "cpp/cpu_render.hh"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// everything the GUI lets the user choose for a render
+struct render_request
+{
+    bool on_device = false;
+    int image_height = 1080;
+    double aspect_ratio = 16.0 / 9.0;
+    int samples_per_pixel = 10;
+    int max_depth = 10;
+    bool russian_roulette = false;
+    int roulette_min_depth = 3;
+    bool single_precision = false; // cpu renders only, the gpu always uses float
+    sampler_kind sampling = sampler_kind::owen; // cpu renders only
+    bool denoise = false;                       // cpu renders only
+    int cpu_count = 1;
+    point cam_pos = {13, 2, 3};
+    point focal_point = {0, 0, 0};
+    double vfov = 20;
+    double defocus_angle = 0.6;
+
+    bool operator==(const render_request &other) const
+    {
+        return on_device == other.on_device && image_height == other.image_height && aspect_ratio == other.aspect_ratio &&
+               samples_per_pixel == other.samples_per_pixel && max_depth == other.max_depth &&
+               russian_roulette == other.russian_roulette && roulette_min_depth == other.roulette_min_depth &&
+               single_precision == other.single_precision && sampling == other.sampling && denoise == other.denoise && cpu_count == other.cpu_count && cam_pos.x == other.cam_pos.x && cam_pos.y == other.cam_pos.y &&
+               cam_pos.z == other.cam_pos.z && focal_point.x == other.focal_point.x &&
+               focal_point.y == other.focal_point.y && focal_point.z == other.focal_point.z && vfov == other.vfov &&
+               defocus_angle == other.defocus_angle;
+    }
+
+    bool operator!=(const render_request &other) const { return !(*this == other); }
+};
+
+// Runs one render at a time on a background thread so the GUI keeps drawing. The image ends up in snapshot, cpu renders
+// publish it after every pass. Starting a new render cancels the running one instead of waiting for it.
+class render_job
+{
+public:
+    render_snapshot snapshot; // image of the latest render, polled by the GUI
+
+    ~render_job()
+    {
+        cancel();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // cancels the running render and starts a new one, returns right away
+    void start(const render_request &request)
+    {
+        cancel();
+        auto progress = std::make_shared<render_progress>();
+        current_progress = progress;
+        current_request = request;
+        busy.store(true, std::memory_order_release);
+
+        // the new thread first waits for the cancelled one, renders never overlap and the GUI thread never blocks
+        worker = std::thread([this, request, progress, previous = std::move(worker)]() mutable
+                             {
+            if (previous.joinable())
+                previous.join();
+            if (!progress->cancelled())
+                run(request, *progress);
+            if (!progress->cancelled())
+                busy.store(false, std::memory_order_release); });
+    }
+
+    // stops the running cpu render at the next tile boundary, a gpu render can't be interrupted and is only discarded
+    void cancel()
+    {
+        if (current_progress)
+            current_progress->cancel();
+        busy.store(false, std::memory_order_release);
+    }
+
+    bool running() const
+    {
+        return busy.load(std::memory_order_acquire);
+    }
+
+    // share of the running cpu render that is done, gpu renders don't report progress
+    double fraction() const
+    {
+        return current_progress ? current_progress->fraction() : 0.0;
+    }
+
+    double last_render_time() const
+    {
+        return render_time.load(std::memory_order_relaxed);
+    }
+
+    // request of the running or last render
+    const render_request &request() const
+    {
+        return current_request;
+    }
+
+private:
+    std::thread worker;
+    std::shared_ptr<render_progress> current_progress; // also held by the worker, outlives a restart
+    render_request current_request;
+    std::atomic<bool> busy{false};
+    std::atomic<double> render_time{0.0};
+
+    void run(const render_request &request, render_progress &progress)
+    {
+        double time = 0.0;
+        if (request.on_device)
+        {
+            // render into a private snapshot so a discarded gpu render never shows up
+            render_snapshot result;
+            gpu_render(request.image_height, request.aspect_ratio, request.samples_per_pixel, request.max_depth,
+                       request.cam_pos, request.focal_point, request.vfov, request.defocus_angle, time,
+                       request.russian_roulette, request.roulette_min_depth, &result);
+            if (progress.cancelled())
+                return;
+            std::lock_guard<std::mutex> result_guard(result.lock);
+            std::lock_guard<std::mutex> guard(snapshot.lock);
+            snapshot.rgba.swap(result.rgba);
+            snapshot.width = result.width;
+            snapshot.height = result.height;
+            snapshot.samples = result.samples;
+            snapshot.denoise_time = result.denoise_time;
+            snapshot.version.fetch_add(1, std::memory_order_release);
+        }
+        else
+        {
+            cpu_render_settings settings;
+            settings.image_height = request.image_height;
+            settings.aspect_ratio = request.aspect_ratio;
+            settings.samples_per_pixel = request.samples_per_pixel;
+            settings.max_depth = request.max_depth;
+            settings.russian_roulette = request.russian_roulette;
+            settings.roulette_min_depth = request.roulette_min_depth;
+            settings.single_precision = request.single_precision;
+            settings.sampling = request.sampling;
+            settings.denoise = request.denoise;
+            settings.cam_pos = request.cam_pos;
+            settings.focal_point = request.focal_point;
+            settings.vfov = request.vfov;
+            settings.defocus_angle = request.defocus_angle;
+            settings.cpu_count = request.cpu_count;
+            settings.output_file = ""; // the image is only shown, not written
+            settings.progress = &progress;
+            settings.progressive = true; // a new image after every sample per pixel
+            settings.snapshot = &snapshot;
+            cpu_render(settings, time);
+        }
+        if (!progress.cancelled())
+            render_time.store(time, std::memory_order_relaxed);
+    }
+};
+
+#endif